@@ -1,7 +1,200 @@
 #include "congo.h"
+#include "congo_weights.h"
+
+//Evaluation material by Piece (lions are not counted) and piece-square tables, black ones turned around
+constexpr std::array<int, PieceCount + 1> PieceValues = {PawnValue, ElephantValue, ZebraValue, 0, MonkeyValue,
+                                                         CrocodileValue, PawnValue, ElephantValue, ZebraValue, 0,
+                                                         MonkeyValue, CrocodileValue, 0};
+
+constexpr std::array<std::array<int, 49>, PieceCount + 1> makePieceSquareTables() {
+    std::array<std::array<int, 49>, PieceCount + 1> tables{};
+    const std::array<int, 49> *white[] = {&PawnSquareTable, &ElephantSquareTable, &ZebraSquareTable,
+                                          &LionSquareTable, &MonkeySquareTable, &CrocodileSquareTable};
+    for (int p = 0; p < BlackPawn; ++p) {
+        for (int square = 0; square < 49; ++square) {
+            tables[p][square] = (*white[p])[square];
+            tables[p + BlackPawn][square] = (*white[p])[48 - square];
+        }
+    }
+    return tables;
+}
+
+constexpr std::array<std::array<int, 49>, PieceCount + 1> PieceSquareTables = makePieceSquareTables();
 
 
 namespace Congo {
+    /*
+     * Charges time, and the cycles, instructions, cache misses and branch mispredictions of the thread it was
+     * opened on (perf_event_open, user space only), to the search phase running. A phase entered inside another
+     * pauses it, so each phase gets only its own cost. Counters are read with rdpmc when the kernel allows it and
+     * by read() otherwise; counters the machine or perf_event_paranoid refuses stay unavailable and only time is
+     * kept for them. Allocations are charged too when they are tracked.
+     */
+    class PhaseProfiler {
+    public:
+        PhaseProfiler() = default;
+
+        PhaseProfiler(const PhaseProfiler &) = delete;
+
+        PhaseProfiler &operator=(const PhaseProfiler &) = delete;
+
+        ~PhaseProfiler() {
+            for (int c = 0; c < PERF_COUNTERS; ++c) {
+                if (pages[c] != nullptr) {
+                    munmap((void *) pages[c], sysconf(_SC_PAGESIZE));
+                }
+                if (fds[c] >= 0) {
+                    close(fds[c]);
+                }
+            }
+        }
+
+        //Opens the counters for the calling thread, which must be the one searching; false when none are given
+        bool open() {
+            const unsigned long long configs[PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                               PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+            bool any = false;
+            for (int c = 0; c < PERF_COUNTERS; ++c) {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[c];
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fds[c] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+                if (fds[c] < 0) {
+                    continue;
+                }
+                void *page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[c], 0);
+                pages[c] = page == MAP_FAILED ? nullptr : (const volatile perf_event_mmap_page *) page;
+                any = true;
+            }
+            return any;
+        }
+
+        std::array<bool, PERF_COUNTERS> available() const {
+            std::array<bool, PERF_COUNTERS> open{};
+            for (int c = 0; c < PERF_COUNTERS; ++c) {
+                open[c] = fds[c] >= 0;
+            }
+            return open;
+        }
+
+        const std::array<PhaseCounters, PhaseCount> &getPhases() const {
+            return phases;
+        }
+
+        void reset() {
+            phases = {};
+        }
+
+        void enter(int phase) {
+            charge();
+            if (nesting < PERF_MAX_NESTING) {
+                running[nesting] = phase;
+            }
+            nesting++;
+            phases[phase].calls++;
+        }
+
+        void leave() {
+            charge();
+            nesting--;
+        }
+
+    private:
+        int fds[PERF_COUNTERS] = {-1, -1, -1, -1};
+        const volatile perf_event_mmap_page *pages[PERF_COUNTERS] = {};
+        std::array<PhaseCounters, PhaseCount> phases{};
+        int running[PERF_MAX_NESTING] = {};
+        int nesting = 0;
+        unsigned long long lastTime = 0;
+        std::array<unsigned long long, PERF_COUNTERS> last{};
+        unsigned long long lastAllocations = 0;
+        unsigned long long lastBytes = 0;
+
+        unsigned long long readCounter(int c) const {
+#if defined(__x86_64__)
+            const volatile perf_event_mmap_page *page = pages[c];
+            //The kernel bumps lock while it moves the counter, so a read is retried until lock holds still
+            while (page != nullptr && page->cap_user_rdpmc) {
+                unsigned int sequence = page->lock;
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+                unsigned int index = page->index;
+                long long count = page->offset;
+                if (index == 0) {
+                    break;
+                }
+                int shift = 64 - page->pmc_width;
+                count += (long long) ((unsigned long long) __builtin_ia32_rdpmc((int) index - 1) << shift) >> shift;
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+                if (page->lock == sequence) {
+                    return (unsigned long long) count;
+                }
+            }
+#endif
+            unsigned long long value = 0;
+            return read(fds[c], &value, sizeof(value)) == (ssize_t) sizeof(value) ? value : 0;
+        }
+
+        //Adds the cost since the last call to the innermost running phase
+        void charge() {
+            auto now = (unsigned long long) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            std::array<unsigned long long, PERF_COUNTERS> counts{};
+            for (int c = 0; c < PERF_COUNTERS; ++c) {
+                counts[c] = fds[c] >= 0 ? readCounter(c) : 0;
+            }
+            unsigned long long allocations = getAllocationCount();
+            unsigned long long bytes = getAllocatedBytes();
+            if (nesting > 0 && nesting <= PERF_MAX_NESTING) {
+                PhaseCounters &phase = phases[running[nesting - 1]];
+                phase.nanoseconds += now - lastTime;
+                for (int c = 0; c < PERF_COUNTERS; ++c) {
+                    phase.counters[c] += counts[c] - last[c];
+                }
+                phase.allocations += allocations - lastAllocations;
+                phase.allocatedBytes += bytes - lastBytes;
+            }
+            lastTime = now;
+            last = counts;
+            lastAllocations = allocations;
+            lastBytes = bytes;
+        }
+    };
+
+    //The profiler of the search running on this thread, if any
+    thread_local PhaseProfiler *activeProfiler = nullptr;
+
+    struct PhaseScope {
+        explicit PhaseScope(int phase) : profiler(activeProfiler) {
+            if (profiler != nullptr) {
+                profiler->enter(phase);
+            }
+        }
+
+        ~PhaseScope() {
+            if (profiler != nullptr) {
+                profiler->leave();
+            }
+        }
+
+        PhaseProfiler *profiler;
+    };
+
+    //Makes profiler the active one of the thread for a search, restoring the previous one after
+    struct ProfilerBinding {
+        explicit ProfilerBinding(PhaseProfiler *profiler) : previous(activeProfiler) {
+            activeProfiler = profiler;
+        }
+
+        ~ProfilerBinding() {
+            activeProfiler = previous;
+        }
+
+        PhaseProfiler *previous;
+    };
+
     class Board {
     public:
         explicit Board(const std::string &fen) {
@@ -10,34 +203,25 @@ namespace Congo {
             turnNum = getTurnNumber(fen);
         }
 
-        Board(const Board &b) : board(b.board), toPlay(b.toPlay), turnNum(b.turnNum), PieceLists(b.PieceLists) {}
+        Board(const std::array<char, 49> &b, char tP, int tN) : board(b), toPlay(tP), turnNum(tN) {}
 
-        void updatePiecePositions(int des) {
-            std::map<int, char> changePairs;
-            for (const auto &i: PieceLists) {
-                for (auto j: i.second) {
-                    if (board[j] != i.first) {
-                        changePairs[j] = i.first;
-                    }
-                }
-            }
+        explicit Board(const PackedPosition &packed) : Board(unpackedSquares(packed), packed.black ? 'b' : 'w',
+                                                             packed.turn) {}
 
-            for (auto i: changePairs) {
-                PieceLists[i.second].erase(i.first);
-            }
-            if (board[des] != '_') {
-                PieceLists[board[des]].insert(des);
+        //Keeps an NNUE accumulator for the network up to date through makeMove, nullptr stops it
+        void setNetwork(const NNUENetwork *net) {
+            network = net;
+            if (network != nullptr) {
+                refreshAccumulator(*network, accumulator, board);
             }
         }
 
-        void printPiecePositions() {
-            for (const auto &i: PieceLists) {
-                std::cout << i.first << " ";
-                for (auto j: i.second) {
-                    std::cout << j << " ";
-                }
-                std::cout << std::endl;
-            }
+        const NNUENetwork *getNetwork() const {
+            return network;
+        }
+
+        const NNUEAccumulator &getAccumulator() const {
+            return accumulator;
         }
 
         std::array<char, 49> buildBoard(std::string fen) {
@@ -56,13 +240,6 @@ namespace Congo {
                         int num = j - '0';
                         total += num;
                     } else {
-                        if (PieceLists.find(j) == PieceLists.end()) {
-                            std::set<int> pos;
-                            pos.insert(total);
-                            PieceLists[j] = pos;
-                        } else {
-                            PieceLists[j].insert(total);
-                        }
                         board[total] = j;
                         total++;
                     }
@@ -76,13 +253,14 @@ namespace Congo {
             return board;
         }
 
-        std::map<char, std::set<int>> getPiecePositions() const {
-            return PieceLists;
+        PackedPosition pack() const {
+            return packPosition(board, toPlay, turnNum);
         }
 
         void makeMove(const std::string &move) {
-            std::string loc = move.substr(0, move.size() / 2);
-            std::string des = move.substr(move.size() / 2);
+            PHASE_SCOPE(PhaseMakeMove);
+            std::string loc = move.substr(0, 2);
+            std::string des = move.substr(move.size() - 2);
             int locIndex = getIndexFromCoord(loc);
             int desIndex = getIndexFromCoord(des);
             int locNum = (int) (loc[1] - '0') - 1;
@@ -101,36 +279,60 @@ namespace Congo {
             }
 
             std::vector<char> beforeRiver(board.begin() + 21, board.begin() + 28);
+            std::array<char, 49> beforeMove = board;
 
-            if ((isupper(board[locIndex]) && isupper(board[desIndex])) ||
-                (std::islower(board[locIndex]) && std::islower(board[desIndex]))) {
+            if (desIndex != locIndex && ((isupper(board[locIndex]) && isupper(board[desIndex])) ||
+                                         (std::islower(board[locIndex]) && std::islower(board[desIndex])))) {
                 throw std::invalid_argument("Can't Take Your Own Piece");
             }
 
-            if (locNum == desNum && locNum == 3) {
+            //A monkey's chain of jumps may end where it started; its jumped pieces go with the move
+            char piece = board[locIndex];
+            board[locIndex] = '_';
+            if (toupper(piece) == 'M') {
+                forEachJumpedSquare(move, [&](int square) { board[square] = '_'; });
+            }
+            if (locNum == desNum && locNum == 3 && toupper(piece) != 'C') {
                 board[desIndex] = '_';
-                board[locIndex] = '_';
             } else {
-                board[desIndex] = board[locIndex];
-                board[locIndex] = '_';
+                board[desIndex] = piece;
             }
 
             std::vector<char> afterRiver(board.begin() + 21, board.begin() + 28);
 
             vectorRiverRemoval(beforeRiver, afterRiver);
+            if (network != nullptr) {
+                for (int i = 0; i < 49; ++i) {
+                    if (beforeMove[i] != board[i]) {
+                        if (beforeMove[i] != '_') {
+                            updateAccumulator(*network, accumulator, beforeMove[i], i, -1);
+                        }
+                        if (board[i] != '_') {
+                            updateAccumulator(*network, accumulator, board[i], i, 1);
+                        }
+                    }
+                }
+            }
+            //Captures, drownings and pawn moves can not be undone, so no earlier position can come back
+            bool irreversible = toupper(beforeMove[locIndex]) == 'P' ||
+                                std::count(board.begin(), board.end(), '_') !=
+                                std::count(beforeMove.begin(), beforeMove.end(), '_');
+            reversibleMoves = irreversible ? 0 : reversibleMoves + 1;
             if (toPlay == 'b') {
                 turnNum++;
             }
             toPlay = flipColour(toPlay);
-            updatePiecePositions(desIndex);
         }
 
         std::vector<std::string> GenerateAllLegalMoves() const {
+            PHASE_SCOPE(PhaseMoveGen);
             std::vector<std::string> AllMoves;
             DumpVectorContents(AllMoves, LionMoves(board, toPlay));
             DumpVectorContents(AllMoves, ZebraMoves(board, toPlay));
             DumpVectorContents(AllMoves, ElephantMoves(board, toPlay));
             DumpVectorContents(AllMoves, PawnMoves(board, toPlay));
+            MonkeyMoves(board, toPlay, AllMoves);
+            CrocodileMoves(board, toPlay, AllMoves);
             //std::sort(AllMoves.begin(), AllMoves.end());
             return AllMoves;
         }
@@ -232,12 +434,8 @@ namespace Congo {
 
         std::string getFen() const {
 
-            std::string fen(49, '1');
-            for (const auto &i: PieceLists) {
-                for (auto j: i.second) {
-                    fen[j] = i.first;
-                }
-            }
+            std::string fen(board.begin(), board.end());
+            std::replace(fen.begin(), fen.end(), '_', '1');
             int j = 0;
             for (int i = 7; i < 49; i += 7) {
                 fen.insert(i + j, "/");
@@ -253,17 +451,11 @@ namespace Congo {
         }
 
         std::string getPieceString(char colour) const {
-            std::string pieces = getFen();
-            pieces.erase(remove_if(pieces.begin(), pieces.end(), [](char c) { return !isalpha(c); }), pieces.end());
-            pieces.pop_back();
-            if (colour == 'w') {
-                pieces.erase(
-                        remove_if(pieces.begin(), pieces.end(), [](char c) { return !std::isupper(c); }),
-                        pieces.end());
-            } else {
-                pieces.erase(
-                        remove_if(pieces.begin(), pieces.end(), [](char c) { return !std::islower(c); }),
-                        pieces.end());
+            std::string pieces;
+            for (auto c: board) {
+                if (colour == 'w' ? std::isupper(c) : std::islower(c)) {
+                    pieces += c;
+                }
             }
             return pieces;
         }
@@ -288,6 +480,15 @@ namespace Congo {
             return turnNum;
         }
 
+        //Plies since the last capture, drowning or pawn move, the window in which positions can repeat
+        int getReversibleMoves() const {
+            return reversibleMoves;
+        }
+
+        void setReversibleMoves(int plies) {
+            reversibleMoves = plies;
+        }
+
         void flipToPlay() {
             if (toPlay == 'w') {
                 toPlay = 'b';
@@ -297,22 +498,26 @@ namespace Congo {
         }
 
     private:
-        std::map<char, std::set<int>> PieceLists;
         std::array<char, 49> board{};
         char toPlay;
         int turnNum;
-        std::map<char, int> pieceCapture = {{'P', 100},
-                                            {'p', 100},
-                                            {'Z', 300},
-                                            {'z', 300},
-                                            {'E', 200},
-                                            {'e', 200},
-                                            {'l', 10000},
-                                            {'L', 10000}};
+        int reversibleMoves = 0;
+        const NNUENetwork *network = nullptr;
+        NNUEAccumulator accumulator{};
+
+        static std::array<char, 49> unpackedSquares(const PackedPosition &packed) {
+            std::array<char, 49> b{};
+            unpackSquares(packed.squares, b);
+            return b;
+        }
 
         void vectorRiverRemoval(std::vector<char> before, std::vector<char> after) {
             std::vector<char> newRiver = after;
             for (int i = 0; i < before.size(); ++i) {
+                //Crocodiles live in the river
+                if (toupper(before[i]) == 'C') {
+                    continue;
+                }
                 if (toPlay == 'w') {
                     if (isupper(before[i]) && before[i] == after[i]) {
                         newRiver[i] = '_';
@@ -331,7 +536,7 @@ namespace Congo {
         }
 
         int isEndGameMove(const std::string &move) const {
-            std::string des = move.substr(move.size() / 2);
+            std::string des = move.substr(move.size() - 2);
             int desIndex = getIndexFromCoord(des);
             char desPiece = board[desIndex];
             if (desPiece == 'L' || desPiece == 'l') {
@@ -342,10 +547,10 @@ namespace Congo {
 
 
         static int isAttackedTileHelper(const std::vector<std::string> &AllMoves, const std::string &move) {
-            std::string des = move.substr(move.size() / 2);
+            std::string des = move.substr(move.size() - 2);
             int total = 0;
             for (auto m: AllMoves) {
-                std::string desM = move.substr(move.size() / 2);
+                std::string desM = move.substr(move.size() - 2);
                 if (des == desM) {
                     total += -5;
                 }
@@ -355,840 +560,4491 @@ namespace Congo {
 
     };
 
+    //Search copies a Board per node, so it must stay a flat block of memory
+    static_assert(std::is_trivially_copyable<Board>::value, "Board must be trivially copyable");
+
     enum FLAG {
         EXACT,
         LOWERBOUND,
         UPPERBOUND
     };
 
+    //16 byte transposition table slot; a zero key marks an empty slot
     struct HashEntry {
-        HashEntry(int d, int s, FLAG f, std::string m, char tP) {
-            depth = d;
-            score = s;
-            flag = f;
-            move = std::move(m);
-            toPlay = tP;
-        }
-
-        int depth;
+        unsigned long long key;
         int score;
-        std::string move;
-        char toPlay;
-        FLAG flag;
+        unsigned short move;
+        signed char depth;
+        unsigned char flag;
     };
 
-    class MiniMax {
+    /*
+     * Fixed size transposition table: a power of two count of HashEntry slots indexed by the low bits of the
+     * position key and verified with the full key, always replacing. The memory is an anonymous mapping
+     * aligned to 2MB and advised for transparent huge pages, so multi-GB tables do not thrash the TLB.
+     */
+    class HashTable {
     private:
-        std::mt19937 mt;
-        std::string bestMove;
-        std::chrono::duration<double> startTime;
-        int LastCompletedDepth = 1;
-        std::unordered_map<unsigned long long int, HashEntry *> TranspositionTable;
+        HashEntry *entries = nullptr;
+        void *mapping = nullptr;
+        size_t mappingBytes = 0;
+        size_t count = 0;
+
+        void release() {
+            if (mapping != nullptr) {
+                munmap(mapping, mappingBytes);
+            }
+            mapping = nullptr;
+            entries = nullptr;
+            mappingBytes = 0;
+            count = 0;
+        }
 
-        unsigned long long int randomInt() {
-            std::uniform_int_distribution<unsigned long long int>
-                    dist(0, UINT64_MAX);
-            return dist(mt);
+    public:
+        explicit HashTable(size_t megabytes = TT_DEFAULT_MB) {
+            resize(megabytes);
         }
 
-        void initZobristTable() {
-            for (auto &i: ZobristTable) {
-                for (unsigned long long &j: i) {
-                    j = randomInt();
-                }
-            }
+        HashTable(const HashTable &) = delete;
+
+        HashTable &operator=(const HashTable &) = delete;
+
+        HashTable(HashTable &&other) noexcept {
+            *this = std::move(other);
         }
 
-        unsigned long long int computeHash(std::array<char, 49> board) {
-            unsigned long long int h = 0;
-            for (int i = 0; i < board.size(); ++i) {
-                if (board[i] != '_') {
-                    int j = ZobristPieceIndex[board[i]];
-                    h ^= ZobristTable[i][j];
-                }
+        HashTable &operator=(HashTable &&other) noexcept {
+            if (this != &other) {
+                release();
+                std::swap(entries, other.entries);
+                std::swap(mapping, other.mapping);
+                std::swap(mappingBytes, other.mappingBytes);
+                std::swap(count, other.count);
             }
-            return h;
+            return *this;
         }
 
-        void storeEntry(const Board &b, HashEntry *entry) {
-            int transposition_index = (int) computeHash(b.getBoard()) & 0xFFFF;
-            TranspositionTable[transposition_index] = entry;
+        ~HashTable() {
+            release();
         }
 
-        HashEntry *GetTranspositionEntry(const Board &board) {
-            int transposition_index = (int) computeHash(board.getBoard()) & 0xFFFF;
-            if (TranspositionTable.find(transposition_index) != TranspositionTable.end()) {
-                return TranspositionTable[transposition_index];
+        //Reallocates to the largest power of two entry count that fits in megabytes; fresh mappings read as zero
+        void resize(size_t megabytes, int threads = 1) {
+            release();
+            size_t target = std::max<size_t>(1, megabytes) * 1024 * 1024 / sizeof(HashEntry);
+            count = 1;
+            while (count * 2 <= target) {
+                count *= 2;
+            }
+            const size_t hugePage = 2 * 1024 * 1024;
+            mappingBytes = count * sizeof(HashEntry) + hugePage;
+            mapping = mmap(nullptr, mappingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED) {
+                mapping = nullptr;
+                throw std::runtime_error("Cannot allocate a " + std::to_string(megabytes) + "MB hash table");
+            }
+            auto aligned = ((uintptr_t) mapping + hugePage - 1) & ~(uintptr_t) (hugePage - 1);
+            entries = reinterpret_cast<HashEntry *>(aligned);
+#ifdef MADV_HUGEPAGE
+            madvise(entries, count * sizeof(HashEntry), MADV_HUGEPAGE);
+#endif
+            if (threads > 1) {
+                clear(threads);
             }
-            return nullptr;
         }
 
-        void initPieceSquareTables() {
-            std::array<int, 49> zebraPieceSquare =
-                    {-50, -40, -30, -30, -30, -40, -50,
-                     -40, -20, 0, 0, 0, -20, -40,
-                     -30, 0, 10, 15, 10, 00, -30,
-                     -30, -5, -15, -20, -15, -5, -30,
-                     -30, 0, 10, 15, 10, 0, -30,
-                     -40, -20, 0, 0, 0, -2, -40,
-                     -50, -40, -30, -30, -30, -40, -50};
-
-            std::array<int, 49> lionPieceSquare =
-                    {0, 0, 0, 0, 0, 0, 0,
-                     0, 0, 0, 0, 0, 0, 0,
-                     0, 0, 0, 0, -0, 0, 0,
-                     0, 0, 0, 0, 0, 0, 0,
-                     0, 0, -20, -10, -20, 0, 0,
-                     0, 0, -5, 2, -5, 0, 0,
-                     0, 0, 10, 0, 10, 0, 0};
-
-            //Pawns
-            std::array<int, 49> PawnPieceSquare =
-                    {0, 0, 0, 0, 0, 0, 0,
-                     5, 5, 5, 5, 5, 5, 5,
-                     7, 8, 9, 10, 9, 8, 7,
-                     -7, -5, -4, -3, -4, -5, -7,
-                     -3, 2, 7, 8, 7, 2, -3,
-                     3, 3, 9, 9, 9, 3, 3,
-                     0, 0, 0, 0, 0, 0, 0};
-
-            std::array<int, 49> ElephantPieceSquare =
-                    {-50, -30, -30, -30, -30, -30, -50,
-                     -20, 10, 10, 15, 10, 10, -20,
-                     -20, 20, 25, 30, 25, 20, -20,
-                     -25, -5, -5, -5, -5, -5, -25,
-                     -20, 20, 25, 30, 25, 20, -20,
-                     -20, 10, 10, 15, 10, 10, -20,
-                     -50, -30, -30, -30, -30, -30, -50};
-
-            PieceSquareTables['L'] = lionPieceSquare;
-            PieceSquareTables['P'] = PawnPieceSquare;
-            PieceSquareTables['Z'] = zebraPieceSquare;
-            PieceSquareTables['E'] = ElephantPieceSquare;
-            std::reverse(lionPieceSquare.begin(), lionPieceSquare.end());
-            std::reverse(PawnPieceSquare.begin(), PawnPieceSquare.end());
-            PieceSquareTables['l'] = lionPieceSquare;
-            PieceSquareTables['p'] = PawnPieceSquare;
-            PieceSquareTables['z'] = zebraPieceSquare;
-            PieceSquareTables['e'] = ElephantPieceSquare;
+        //Zeroes the table in 1MB chunks spread over threads, which also faults the pages in on those threads
+        void clear(int threads = 1) {
+            size_t chunk = std::max<size_t>(1, 1024 * 1024 / sizeof(HashEntry));
+            parallelFor(count, chunk, threads, [&](size_t begin, size_t end) {
+                std::memset((void *) (entries + begin), 0, (end - begin) * sizeof(HashEntry));
+            });
         }
 
+        const HashEntry *probe(unsigned long long key) const {
+            const HashEntry &entry = entries[key & (count - 1)];
+            return entry.key == key ? &entry : nullptr;
+        }
 
-    public:
-        MiniMax() : mt((std::random_device()) ()) {
-            initZobristTable();
-            initPieceSquareTables();
+        //move is an encodeTableMove code, 0 for none
+        void store(unsigned long long key, int depth, int score, FLAG flag, unsigned short move) {
+            HashEntry &entry = entries[key & (count - 1)];
+            entry.key = key;
+            entry.score = score;
+            entry.move = move;
+            entry.depth = (signed char) depth;
+            entry.flag = (unsigned char) flag;
         }
 
-        int negINF = -10000000;
-        int INF = 10000000;
-        std::map<char, std::array<int, 49>> PieceSquareTables;
-        std::map<int, std::pair<int, std::string>> DepthMoves;
-        std::map<char, int> pieceValues = {{'P', 100},
-                                           {'p', 100},
-                                           {'Z', 300},
-                                           {'z', 300},
-                                           {'E', 200},
-                                           {'e', 200}};
+        //Used slots per thousand, sampled from the first thousand entries
+        int hashfull() const {
+            size_t sample = std::min<size_t>(1000, count);
+            size_t used = 0;
+            for (size_t i = 0; i < sample; ++i) {
+                used += entries[i].key != 0;
+            }
+            return (int) (used * 1000 / sample);
+        }
+
+        size_t size() const {
+            return count;
+        }
+    };
+
+    /*
+     * Opening book file: a BookHeader followed by BookEntry records sorted by key.
+     * Several entries may share a key, one per book move, heaviest first.
+     */
+    struct BookHeader {
+        char magic[4];
+        unsigned int version;
+        unsigned long long count;
+    };
 
+    struct BookEntry {
+        unsigned long long key;
+        //encodeTableMove code
+        unsigned short move;
+        unsigned short weight;
+        unsigned int reserved;
+    };
 
-        std::map<char, int> ZobristPieceIndex = {{'P', 0},
-                                                 {'E', 1},
-                                                 {'Z', 2},
-                                                 {'L', 3},
-                                                 {'p', 4},
-                                                 {'e', 5},
-                                                 {'z', 6},
-                                                 {'l', 7}};
-        std::array<std::array<unsigned long long int, 8>, 49> ZobristTable{};
+    class OpeningBook {
+    public:
+        OpeningBook() = default;
 
+        OpeningBook(const OpeningBook &) = delete;
 
-        int BasicBoardEvaluation(const Board &board) {
-            int eval;
-            int factor = 1;
-            char toPlay = board.getToPlay();
-            if (toPlay == 'b') {
-                factor = -1;
+        OpeningBook &operator=(const OpeningBook &) = delete;
+
+        ~OpeningBook() {
+            close();
+        }
+
+        bool open(const std::string &path) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(BookHeader)) {
+                ::close(fd);
+                return false;
+            }
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                return false;
             }
 
-            char winner = board.isGameOver();
-            if (winner == 'w') {
-                return factor * 10000;
+            auto header = (const BookHeader *) data;
+            size_t expected = sizeof(BookHeader) + header->count * sizeof(BookEntry);
+            if (std::string(header->magic, 4) != BOOK_MAGIC || header->version != BOOK_VERSION ||
+                expected > (size_t) st.st_size) {
+                munmap(data, st.st_size);
+                return false;
             }
-            if (winner == 'b') {
-                return factor * -10000;
+
+            mapping = data;
+            mappingSize = st.st_size;
+            entries = (const BookEntry *) ((const char *) data + sizeof(BookHeader));
+            count = header->count;
+            return true;
+        }
+
+        void close() {
+            if (mapping != nullptr) {
+                munmap(mapping, mappingSize);
             }
+            mapping = nullptr;
+            mappingSize = 0;
+            entries = nullptr;
+            count = 0;
+        }
 
+        bool isOpen() const {
+            return mapping != nullptr;
+        }
 
-            std::string whitePieces = board.getPieceString('w');
-            std::string blackPieces = board.getPieceString('b');
+        size_t size() const {
+            return count;
+        }
 
-            if (whitePieces == "L" && blackPieces == "l") {
-                return 0;
+        //Book moves of board, whose key is key; a monkey's chain needs the board to be decoded
+        std::vector<std::pair<std::string, int>> probeAll(const Board &board, unsigned long long key) const {
+            std::vector<std::pair<std::string, int>> moves;
+            auto first = std::lower_bound(entries, entries + count, key,
+                                          [](const BookEntry &e, unsigned long long k) { return e.key < k; });
+            for (auto it = first; it != entries + count && it->key == key; ++it) {
+                std::string move = decodeTableMove(board.getBoard(), board.getToPlay(), it->move);
+                if (!move.empty()) {
+                    moves.emplace_back(move, it->weight);
+                }
             }
+            return moves;
+        }
 
-            //Piece Value
-            int wTotal = 0;
-            int bTotal = 0;
+        //Picks one of the book moves for board at random, proportional to its weight
+        std::string probe(const Board &board, unsigned long long key, std::mt19937 &gen) const {
+            auto moves = probeAll(board, key);
+            if (moves.empty()) {
+                return "";
+            }
             int total = 0;
-            for (auto i: whitePieces) {
-                wTotal += pieceValues[i];
+            for (const auto &m: moves) {
+                total += m.second;
             }
-            for (auto i: blackPieces) {
-                bTotal += pieceValues[i];
+            std::uniform_int_distribution<> dis(0, total - 1);
+            int pick = dis(gen);
+            for (const auto &m: moves) {
+                pick -= m.second;
+                if (pick < 0) {
+                    return m.first;
+                }
             }
-            eval = (wTotal - bTotal);
+            return moves.front().first;
+        }
 
+    private:
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+        const BookEntry *entries = nullptr;
+        size_t count = 0;
+    };
 
+    /*
+     * Tablebase file: a TablebaseHeader, blocks + 1 offsets into the data and the run-length encoded
+     * values as (run, value) byte pairs. Each block holds TB_BLOCK_SIZE positions so a probe only
+     * decodes one block. Value 0 is a draw, 1..127 a win for the side to move in that many plies,
+     * 128 + n a loss in n plies. Distances saturate at 127.
+     */
+    struct TablebaseHeader {
+        char magic[4];
+        unsigned int version;
+        char signature[16];
+        unsigned long long positions;
+        unsigned int blockSize;
+        unsigned int blocks;
+    };
 
+    unsigned char encodeTablebaseValue(short value) {
+        if (value > 0) {
+            return (unsigned char) std::min<int>(value, 127);
+        } else if (value < 0) {
+            return (unsigned char) (128 + std::min<int>(-value - 1, 127));
+        }
+        return 0;
+    }
 
-            /* auto x = board.getPiecePositions();
-             for (const auto &i: x) {
-                 auto table = PieceSquareTables[i.first];
-                 for (auto j: i.second) {
-                     eval += table[j];
-                 }
-             }*/
-            return factor * eval;
+    short decodeTablebaseValue(unsigned char value) {
+        if (value == 0) {
+            return 0;
+        } else if (value < 128) {
+            return value;
         }
+        return (short) (-(value - 128) - 1);
+    }
 
+    class Tablebases {
+    public:
+        Tablebases() = default;
 
-        int boardEvaluation(const Board &board) {
-            int eval;
-            int factor = 1;
-            char toPlay = board.getToPlay();
-            if (toPlay == 'b') {
-                factor = -1;
-            }
+        Tablebases(const Tablebases &) = delete;
 
-            char winner = board.isGameOver();
-            if (winner == 'w') {
-                return factor * 10000;
-            }
-            if (winner == 'b') {
-                return factor * -10000;
+        Tablebases &operator=(const Tablebases &) = delete;
+
+        ~Tablebases() {
+            for (auto &i: tables) {
+                munmap(i.second.mapping, i.second.mappingSize);
             }
+        }
 
+        //Maps every .cgtb file in directory, returns the number of tables loaded
+        int load(const std::string &directory) {
+            int loaded = 0;
+            std::error_code ec;
+            for (const auto &file: std::filesystem::directory_iterator(directory, ec)) {
+                if (file.path().extension() == ".cgtb" && loadTable(file.path().string())) {
+                    loaded++;
+                }
+            }
+            return loaded;
+        }
 
-            std::string whitePieces = board.getPieceString('w');
-            std::string blackPieces = board.getPieceString('b');
+        size_t size() const {
+            return tables.size();
+        }
 
-            if (whitePieces == "L" && blackPieces == "l") {
-                return 0;
+        //Score for the side to move, 10000 - plies to lion capture when winning
+        bool probe(const std::array<char, 49> &b, char toPlay, int &score) const {
+            if (tables.empty()) {
+                return false;
             }
-
-            //Piece Value
-            int wTotal = 0;
-            int bTotal = 0;
-            int total = 0;
-            for (auto i: whitePieces) {
-                wTotal += pieceValues[i];
+            int pieces = 0;
+            for (auto i: b) {
+                if (i != '_' && ++pieces > TB_MAX_PIECES) {
+                    return false;
+                }
             }
-            for (auto i: blackPieces) {
-                bTotal += pieceValues[i];
+            std::string signature = getMaterialSignature(b);
+            auto it = tables.find(signature);
+            if (it == tables.end()) {
+                return false;
             }
-            eval = (wTotal - bTotal);
-
+            long long index = getTablebaseIndex(b, toPlay, signature);
+            if (index < 0) {
+                return false;
+            }
+            short value = decodeTablebaseValue(lookup(it->second, index));
+            if (value > 0) {
+                score = 10000 - value;
+            } else if (value < 0) {
+                score = -10000 - value - 1;
+            } else {
+                score = 0;
+            }
+            return true;
+        }
 
-            Board oppBoard = board;
-            oppBoard.flipToPlay();
+    private:
+        struct MappedTable {
+            void *mapping;
+            size_t mappingSize;
+            const TablebaseHeader *header;
+            const unsigned long long *offsets;
+            const unsigned char *data;
+        };
+        std::map<std::string, MappedTable> tables;
+
+        bool loadTable(const std::string &path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(TablebaseHeader)) {
+                ::close(fd);
+                return false;
+            }
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                return false;
+            }
 
-            //Mobility Score
-            auto oppMoves = oppBoard.GenerateAllLegalMoves();
-            auto myMoves = board.GenerateAllLegalMoves();
-            if (toPlay == 'w') {
-                eval += (int) (myMoves.size() - oppMoves.size());
-            } else {
-                eval += (int) (oppMoves.size() - myMoves.size());
+            MappedTable table{};
+            table.mapping = data;
+            table.mappingSize = st.st_size;
+            table.header = (const TablebaseHeader *) data;
+            table.offsets = (const unsigned long long *) ((const char *) data + sizeof(TablebaseHeader));
+            table.data = (const unsigned char *) (table.offsets + table.header->blocks + 1);
+            std::string signature(table.header->signature, strnlen(table.header->signature, 16));
+            if (std::string(table.header->magic, 4) != TB_MAGIC || table.header->version != TB_VERSION ||
+                table.header->positions != (unsigned long long) getTablebaseSize(signature) ||
+                table.header->blockSize == 0 || tables.count(signature)) {
+                munmap(data, st.st_size);
+                return false;
             }
+            tables[signature] = table;
+            return true;
+        }
 
-            //Attacking Score
-            int wAttackTotal = 0;
-            int bAttackTotal = 0;
-            auto myBoardArr = board.getBoard();
-            for (const auto &m: myMoves) {
-                int desIndex = getIndexFromCoord(m.substr(m.size() / 2));
-                char desPieces = myBoardArr[desIndex];
-                if (toPlay == 'w') {
-                    if (islower(desPieces)) {
-                        wAttackTotal += 1;
-                        if (desPieces == 'l') {
-                            wAttackTotal += 10;
-                        }
-                    }
-                } else {
-                    if (isupper(desPieces)) {
-                        bAttackTotal += 1;
-                        if (desPieces == 'L') {
-                            bAttackTotal += 10;
-                        }
-                    }
+        static unsigned char lookup(const MappedTable &table, long long index) {
+            unsigned long long block = index / table.header->blockSize;
+            unsigned long long pos = index % table.header->blockSize;
+            const unsigned char *it = table.data + table.offsets[block];
+            const unsigned char *end = table.data + table.offsets[block + 1];
+            for (; it < end; it += 2) {
+                if (pos < it[0]) {
+                    return it[1];
                 }
+                pos -= it[0];
             }
-            auto oppBoardArr = board.getBoard();
-            for (const auto &m: oppMoves) {
-                int desIndex = getIndexFromCoord(m.substr(m.size() / 2));
-                char desPieces = myBoardArr[desIndex];
-                if (toPlay == 'b') {
-                    if (islower(desPieces)) {
-                        wAttackTotal += 1;
-                        if (desPieces == 'l') {
-                            wAttackTotal += 10;
+            return 0;
+        }
+    };
+
+    struct PVLine {
+        int score;
+        std::vector<std::string> pv;
+    };
+
+    /*
+     * Material balance for the side to move of the exchange move starts on its target square, in pieceValues
+     * (lions 10000). Each side recaptures with its least valuable attacker or stops; taking a lion ends the
+     * exchange, a capture along the river drowns the capturer on the spot, and a side's other pieces in the
+     * river drown when it moves (crocodiles never drown). A monkey's jumps score the pieces they take, and a
+     * monkey recapturing is counted as if it landed on the square.
+     */
+    int staticExchange(const Board &board, const std::string &move) {
+        auto b = board.getBoard();
+        int from = getIndexFromCoord(move.substr(0, 2));
+        int to = getIndexFromCoord(move.substr(move.size() - 2));
+        char side = board.getToPlay();
+        auto value = [&](char piece) {
+            return toupper(piece) == 'L' ? 10000 : PieceValues[pieceIndex(piece)];
+        };
+        auto drown = [&](char colour, int keep) {
+            for (int r = 21; r < 28; ++r) {
+                if (r != keep && b[r] != '_' && toupper(b[r]) != 'C' && (colour == 'w') == (bool) isupper(b[r])) {
+                    b[r] = '_';
+                }
+            }
+        };
+        auto drowns = [](char piece, int from, int to) {
+            return from / 7 == 3 && to / 7 == 3 && toupper(piece) != 'C';
+        };
+
+        std::array<int, 32> gain{};
+        int d = 0;
+        gain[0] = value(b[to]);
+        char piece = b[from];
+        if (toupper(piece) == 'M' && getMoveTarget(b, move) != '_') {
+            int taken = 0;
+            forEachJumpedSquare(move, [&](int square) { taken += value(b[square]); });
+            return taken;
+        }
+        if (toupper(b[to]) == 'L') {
+            return gain[0];
+        }
+        b[from] = '_';
+        if (drowns(piece, from, to)) {
+            return gain[0] - value(piece);
+        }
+        b[to] = piece;
+        drown(side, to);
+        while (d < 30) {
+            side = flipColour(side);
+            unsigned long long attackers = toupper(b[to]) == 'L' ? getLionAttackers(b, side)
+                                                                 : getSquareAttackers(b, to, side);
+            if (attackers == 0) {
+                break;
+            }
+            int attacker = -1;
+            for (; attackers; attackers &= attackers - 1) {
+                int sq = __builtin_ctzll(attackers);
+                if (attacker < 0 || value(b[sq]) < value(b[attacker])) {
+                    attacker = sq;
+                }
+            }
+            d++;
+            gain[d] = value(b[to]) - gain[d - 1];
+            if (toupper(b[to]) == 'L' || std::max(-gain[d - 1], gain[d]) < 0) {
+                break;
+            }
+            piece = b[attacker];
+            b[attacker] = '_';
+            if (drowns(piece, attacker, to)) {
+                d++;
+                gain[d] = value(piece) - gain[d - 1];
+                break;
+            }
+            b[to] = piece;
+            drown(side, to);
+        }
+        for (; d > 0; --d) {
+            gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+        }
+        return gain[0];
+    }
+
+    /*
+     * Yields the moves of a position in stages, generating the quiet moves only when the search gets to them: the
+     * table move, captures that win or trade by static exchange (best first), the killer moves of the ply, the
+     * other quiet moves and then losing captures. Table and killer moves are checked against the moves of their
+     * square first. With capturesOnly the picker stops after the winning and even captures.
+     */
+    class MovePicker {
+    public:
+        MovePicker(const Board &board, const std::string &ttMove, const std::string *killers, bool capturesOnly)
+                : board(board), b(board.getBoard()), ttMove(ttMove), killers(killers), capturesOnly(capturesOnly) {}
+
+        //The next move, or nullptr when there are none left; valid until the following call
+        const std::string *next() {
+            switch (stage) {
+                case TableMove:
+                    stage = GenerateCaptures;
+                    if (!capturesOnly && isLegal(ttMove, GEN_ALL)) {
+                        return remember(ttMove);
+                    }
+                    [[fallthrough]];
+                case GenerateCaptures:
+                    stage = GoodCaptures;
+                    generateCaptures();
+                    [[fallthrough]];
+                case GoodCaptures:
+                    while (current < captures.size() && captures[current].first >= 0) {
+                        const std::string &m = moves[captures[current++].second];
+                        if (!isPicked(m)) {
+                            return pick(m);
                         }
                     }
-                } else {
-                    if (isupper(desPieces)) {
-                        bAttackTotal += 1;
-                        if (desPieces == 'L') {
-                            bAttackTotal += 10;
+                    goodEnd = current;
+                    stage = capturesOnly ? Done : Killers;
+                    if (capturesOnly) {
+                        return nullptr;
+                    }
+                    [[fallthrough]];
+                case Killers:
+                    while (killers != nullptr && killerIndex < 2) {
+                        const std::string &m = killers[killerIndex++];
+                        if (!isPicked(m) && isLegal(m, GEN_QUIETS)) {
+                            return remember(m);
+                        }
+                    }
+                    stage = Quiets;
+                    current = moves.size();
+                    generateQuiets();
+                    [[fallthrough]];
+                case Quiets:
+                    while (current < moves.size()) {
+                        const std::string &m = moves[current++];
+                        if (!isPicked(m)) {
+                            return pick(m);
+                        }
+                    }
+                    stage = BadCaptures;
+                    current = goodEnd;
+                    [[fallthrough]];
+                case BadCaptures:
+                    while (current < captures.size()) {
+                        const std::string &m = moves[captures[current++].second];
+                        if (!isPicked(m)) {
+                            return pick(m);
                         }
                     }
+                    stage = Done;
+                    [[fallthrough]];
+                case Done:
+                    return nullptr;
+            }
+            return nullptr;
+        }
+
+        //Moves yielded so far, 1 while searching the first
+        int count() const {
+            return yielded;
+        }
+
+    private:
+        enum Stage {
+            TableMove, GenerateCaptures, GoodCaptures, Killers, Quiets, BadCaptures, Done
+        };
+        const Board &board;
+        std::array<char, 49> b;
+        std::string ttMove;
+        const std::string *killers;
+        bool capturesOnly;
+        Stage stage = TableMove;
+        std::vector<std::string> moves;
+        std::vector<std::pair<int, int>> captures;
+        size_t current = 0;
+        size_t goodEnd = 0;
+        int killerIndex = 0;
+        int yielded = 0;
+        std::array<std::string, 3> picked;
+        int pickedCount = 0;
+
+        //Captures scored by static exchange, best first and in generation order among equals
+        void generateCaptures() {
+            {
+                PHASE_SCOPE(PhaseMoveGen);
+                generateMoves(b, board.getToPlay(), GEN_CAPTURES, moves);
+            }
+            captures.reserve(moves.size());
+            for (int i = 0; i < (int) moves.size(); ++i) {
+                captures.emplace_back(staticExchange(board, moves[i]), i);
+            }
+            std::stable_sort(captures.begin(), captures.end(),
+                             [](const std::pair<int, int> &x, const std::pair<int, int> &y) {
+                                 return x.first > y.first;
+                             });
+        }
+
+        void generateQuiets() {
+            PHASE_SCOPE(PhaseMoveGen);
+            generateMoves(b, board.getToPlay(), GEN_QUIETS, moves);
+        }
+
+        bool isLegal(const std::string &move, int kinds) const {
+            PHASE_SCOPE(PhaseMoveGen);
+            if (move.size() < 4) {
+                return false;
+            }
+            int from = getSquareFromChars(move.data());
+            if (getPieceColour(b[from]) != board.getToPlay()) {
+                return false;
+            }
+            std::vector<std::string> squareMoves;
+            generateSquareMoves(b, board.getToPlay(), from, kinds, squareMoves);
+            return std::find(squareMoves.begin(), squareMoves.end(), move) != squareMoves.end();
+        }
+
+        bool isPicked(const std::string &move) const {
+            return std::find(picked.begin(), picked.begin() + pickedCount, move) != picked.begin() + pickedCount;
+        }
+
+        const std::string *pick(const std::string &move) {
+            yielded++;
+            return &move;
+        }
+
+        //Table and killer moves are kept so the later stages skip them
+        const std::string *remember(const std::string &move) {
+            picked[pickedCount] = move;
+            return pick(picked[pickedCount++]);
+        }
+    };
+
+    /*
+     * Trace file: a TraceHeader, then blocks of one TraceBlock and count TraceEvents, each block from one
+     * searcher's ring. Node numbers count the searcher's nodes from 1 (0 is no node) and every event belongs
+     * to a sampled node:
+     *   TraceEnter  window alpha, beta, move played to reach the node, data the nearest sampled ancestor
+     *   TraceExit   window as entered and score returned
+     *   TraceHit    table entry found: its depth, flag in alpha, score and move, data the position key
+     *   TraceStore  table entry written, the same fields
+     *   TraceCutoff beta cutoff: window, best score and the move that caused it, data moves tried
+     */
+    enum TraceType : unsigned char {
+        TraceEnter, TraceExit, TraceHit, TraceStore, TraceCutoff
+    };
+
+    struct TraceHeader {
+        char magic[4];
+        unsigned int version;
+        unsigned int sample;
+        unsigned int reserved;
+    };
+
+    struct TraceBlock {
+        unsigned int searcher;
+        unsigned int count;
+    };
+
+    struct TraceEvent {
+        unsigned long long node;
+        unsigned long long data;
+        int alpha;
+        int beta;
+        int score;
+        unsigned short move;
+        unsigned char type;
+        signed char depth;
+    };
+
+    static_assert(sizeof(TraceEvent) == 32, "TraceEvent is a 32 byte record");
+
+    /*
+     * The file searches write their traces to. Each MiniMax given the tracer fills its own ring of
+     * TRACE_RING_EVENTS events without locking and hands it over in one block when it is full, so the lock
+     * is taken once per ring. sample traces every sample-th node (1 for all of them).
+     */
+    class SearchTracer {
+    public:
+        bool open(const std::string &path, unsigned int everyNth) {
+            out.open(path, std::ios::binary | std::ios::trunc);
+            sample = std::max(1u, everyNth);
+            TraceHeader header{{'C', 'G', 'T', 'R'}, TRACE_VERSION, sample, 0};
+            out.write((const char *) &header, sizeof(header));
+            return (bool) out;
+        }
+
+        unsigned int getSample() const {
+            return sample;
+        }
+
+        unsigned int addSearcher() {
+            return searchers.fetch_add(1);
+        }
+
+        void write(unsigned int searcher, const TraceEvent *events, size_t count) {
+            if (count == 0) {
+                return;
+            }
+            TraceBlock block{searcher, (unsigned int) count};
+            std::lock_guard<std::mutex> guard(lock);
+            out.write((const char *) &block, sizeof(block));
+            out.write((const char *) events, (std::streamsize) (count * sizeof(TraceEvent)));
+            out.flush();
+        }
+
+    private:
+        std::ofstream out;
+        std::mutex lock;
+        std::atomic<unsigned int> searchers{0};
+        unsigned int sample = 1;
+    };
+
+    class MiniMax {
+    private:
+        std::mt19937 mt;
+        std::string bestMove;
+        std::chrono::duration<double> startTime;
+        int LastCompletedDepth = 1;
+        HashTable TranspositionTable;
+        const OpeningBook *book = nullptr;
+        const Tablebases *tablebases = nullptr;
+        int lionExtensions = 0;
+        std::ostream *statsOutput = nullptr;
+        int lastScore = 0;
+        unsigned long long nodeCount = 0;
+        unsigned long long nodeLimit = 0;
+        bool aborted = false;
+        const std::atomic<bool> *stopFlag = nullptr;
+        std::function<void(int, const PVLine &, unsigned long long, double)> infoCallback;
+        const NNUENetwork *network = nullptr;
+        bool frontierBatching = false;
+        bool quiescenceSearch = false;
+        std::array<int, (PieceCount + 1) * 49> frontierMaterial{};
+        std::array<int, (PieceCount + 1) * 49> frontierPlacement{};
+        std::set<std::string> excludedRootMoves;
+        std::vector<unsigned long long> keyHistory;
+        std::array<unsigned char, REPETITION_FILTER_SIZE> repetitionFilter{};
+        std::array<std::array<std::string, 2>, MAX_KILLER_PLY> killers;
+        int rootPly = 0;
+        PhaseProfiler *profiler = nullptr;
+        std::array<PhaseCounters, PhaseCount> reportedPhases{};
+#ifdef CONGO_TRACE
+        SearchTracer *tracer = nullptr;
+        unsigned int traceSearcher = 0;
+        unsigned int traceCountdown = 1;
+        std::vector<TraceEvent> traceRing;
+        size_t traceCount = 0;
+        unsigned long long traceNodes = 0;
+        unsigned long long traceCurrent = 0;
+        unsigned short traceMove = 0;
+        bool traceSampled = false;
+#endif
+        std::mt19937 bookGen{ZOBRIST_SEED};
+        unsigned long long int ZobristBlackToMove = 0;
+
+        unsigned long long int randomInt() {
+            std::uniform_int_distribution<unsigned long long int>
+                    dist(0, UINT64_MAX);
+            return dist(mt);
+        }
+
+        //Keys for the first eight pieces come out as before the monkey and crocodile, so existing books still match
+        void initZobristTable() {
+            for (auto &i: ZobristTable) {
+                for (char piece: std::string("PEZLpezl")) {
+                    i[pieceIndex(piece)] = randomInt();
                 }
             }
-            eval += wAttackTotal - bAttackTotal;
+            ZobristBlackToMove = randomInt();
+            for (auto &i: ZobristTable) {
+                for (char piece: std::string("MCmc")) {
+                    i[pieceIndex(piece)] = randomInt();
+                }
+            }
+        }
 
+        void storeEntry(const Board &b, int depth, int score, FLAG flag, const std::string &move) {
+            PHASE_SCOPE(PhaseTT);
+            TRACE_EVENT(TraceStore, depth, flag, 0, score, move.empty() ? 0 : encodeMove(move), positionKey(b));
+            TranspositionTable.store(positionKey(b), depth, score, flag,
+                                     move.empty() ? 0 : encodeTableMove(b.getBoard(), b.getToPlay(), move));
+        }
 
-            return factor * eval;
+#ifdef CONGO_TRACE
+        void traceEvent(unsigned char type, int depth, int alpha, int beta, int score, unsigned short move,
+                        unsigned long long data) {
+            traceRing[traceCount++] = {traceCurrent, data, alpha, beta, score, move, type, (signed char) depth};
+            if (traceCount == traceRing.size()) {
+                flushTrace();
+            }
         }
 
-        int negamax(const Board &board, int depth, int initDepth) {
-            if (depth <= 0 || board.isGameOver() != 'n') {
-                return BasicBoardEvaluation(board);
+        void flushTrace() {
+            if (tracer != nullptr) {
+                tracer->write(traceSearcher, traceRing.data(), traceCount);
             }
-            int value = negINF;
-            auto moves = board.GenerateAllLegalMoves();
-            for (const auto &m: moves) {
-                Board nextState = board;
-                nextState.makeMove(m);
-                int childVal = -negamax(nextState, depth - 1, initDepth);
-                if (childVal > value) {
-                    value = childVal;
-                    if (depth == initDepth)
-                        bestMove = m;
+            traceCount = 0;
+        }
+#endif
+
+        //Runs search() as one node of the trace, recording its window and score when the node is sampled
+        template<typename F>
+        int traceNode([[maybe_unused]] int depth, [[maybe_unused]] int alpha, [[maybe_unused]] int beta, F search) {
+#ifdef CONGO_TRACE
+            if (tracer != nullptr) {
+                unsigned long long parent = traceCurrent;
+                bool parentSampled = traceSampled;
+                ++traceNodes;
+                traceSampled = --traceCountdown == 0;
+                if (traceSampled) {
+                    traceCountdown = tracer->getSample();
+                    traceCurrent = traceNodes;
+                    traceEvent(TraceEnter, depth, alpha, beta, 0, traceMove, parent);
                 }
+                traceMove = 0;
+                int score = search();
+                if (traceSampled) {
+                    traceEvent(TraceExit, depth, alpha, beta, score, 0, parent);
+                }
+                traceCurrent = parent;
+                traceSampled = parentSampled;
+                return score;
             }
-            return value;
+#endif
+            return search();
         }
 
-        int AlphaBetaNegamax(const Board &board, int depth, int initDepth, int alpha, int beta) {
-            if (depth == 0 || board.isGameOver() != 'n') {
-                return boardEvaluation(board);
+        //Counts the node and checks the time, node and stop budgets of an iterative search; depth 1 always completes
+        bool budgetExhausted(int initDepth, std::chrono::duration<double> timeLimit) {
+            PHASE_SCOPE(PhaseTimeCheck);
+            ++nodeCount;
+            if (initDepth <= 1) {
+                return false;
             }
-            int value = negINF;
+            if (aborted || (nodeLimit != 0 && nodeCount >= nodeLimit) ||
+                (stopFlag != nullptr && stopFlag->load(std::memory_order_relaxed))) {
+                aborted = true;
+                return true;
+            }
+            auto currTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+            aborted = currTime - startTime >= timeLimit;
+            return aborted;
+        }
 
-            auto moves = board.GenerateAllLegalMoves();
-            for (const auto &m: moves) {
+        const HashEntry *GetTranspositionEntry(const Board &board) {
+            PHASE_SCOPE(PhaseTT);
+            STAT_INC(ttProbes);
+            const HashEntry *entry = TranspositionTable.probe(positionKey(board));
+            if (entry != nullptr) {
+                STAT_INC(ttHits);
+            }
+            return entry;
+        }
+
+        //Material and piece-square scores from white's side by feature, piece * 49 + square in Piece order
+        void initFrontierTables() {
+            for (int p = 0; p < PieceCount; ++p) {
+                int sign = p < BlackPawn ? 1 : -1;
+                for (int square = 0; square < 49; ++square) {
+                    frontierMaterial[p * 49 + square] = sign * PieceValues[p];
+                    frontierPlacement[p * 49 + square] = sign * PieceSquareTables[p][square];
+                }
+            }
+        }
+
+        bool useFrontierBatch(const std::vector<std::string> &moves) const {
+            return frontierBatching && !quiescenceSearch && network == nullptr && moves.size() <= FRONTIER_MAX_CHILDREN;
+        }
+
+        //Depth 0 score of the alpha beta searches: boardEvaluation, or a capture search when quiescence is on
+        int leafEvaluation(const Board &board, int depth, int alpha, int beta) {
+            if (quiescenceSearch && depth == 0 && board.isGameOver() == 'n') {
+                return quiescence(board, alpha, beta, 0);
+            }
+            return boardEvaluation(board);
+        }
+
+        //Captures only from a boardEvaluation stand pat, skipping captures that lose material by static exchange
+        int quiescence(const Board &board, int alpha, int beta, int ply) {
+            STAT_INC(nodes);
+            if (board.isGameOver() != 'n') {
+                return boardEvaluation(board);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                return 10000;
+            }
+            int value = boardEvaluation(board);
+            if (value >= beta || ply >= QUIESCENCE_MAX_PLY) {
+                return value;
+            }
+            alpha = std::max(alpha, value);
+            MovePicker picker(board, "", nullptr, true);
+            while (const std::string *next = picker.next()) {
+                const std::string &m = *next;
                 Board nextState = board;
                 nextState.makeMove(m);
-                int childVal = -AlphaBetaNegamax(nextState, depth - 1, initDepth, -beta, -alpha);
-                if (childVal > value) {
-                    value = childVal;
-                    if (depth == initDepth) {
-                        bestMove = m;
-                    }
-                }
+                value = std::max(value, -quiescence(nextState, -beta, -alpha, ply + 1));
                 alpha = std::max(alpha, value);
                 if (alpha >= beta) {
+                    STAT_CUTOFF(picker.count() == 1);
                     break;
                 }
             }
             return value;
         }
 
-        int AlphaBetaNegamaxWithTT(const Board &board, int depth, int initDepth, int alpha, int beta) {
-            int origAlpha = alpha;
-            HashEntry *entry = GetTranspositionEntry(board);
-            int ttDepth = -1;
-            std::string ttMove, localBestMove = bestMove;
-            FLAG ttFlag;
-            int ttScore;
-            char toPlay = board.getToPlay();
-            if (entry != nullptr) {
-                ttDepth = entry->depth;
-                ttMove = entry->move;
-                ttFlag = entry->flag;
-                ttScore = entry->score;
-                if (entry->toPlay != toPlay) {
-                    ttScore *= -1;
+        /*
+         * True when child i of a frontier batch repeats a position of the game or the search path (the node is on
+         * keyHistory). Only a quiet move of a piece other than a pawn keeps the window open, and its key is the
+         * node's with the piece moved and the other side to move.
+         */
+        bool frontierRepetition(const Board &board, const FrontierBatch &batch, int i) {
+            int piece = batch.before[0][i] / 49;
+            int from = batch.before[0][i] % 49;
+            int to = batch.after[1][i] % 49;
+            if (PieceChars[piece] == 'P' || PieceChars[piece] == 'p' || batch.before[1][i] / 49 != pieceIndex('_') ||
+                batch.after[1][i] / 49 != piece) {
+                return false;
+            }
+            for (int j = 2; j < FRONTIER_CHANGES; ++j) {
+                if (batch.before[j][i] != batch.after[j][i]) {
+                    return false;
                 }
-                if (ttDepth >= depth && ttDepth != initDepth) {
+            }
+            unsigned long long key = keyHistory.back() ^ ZobristBlackToMove ^ ZobristTable[from][piece] ^
+                                     ZobristTable[to][piece];
+            return isRepetition(board.getReversibleMoves() + 1, key);
+        }
 
-                    if (ttFlag == EXACT) {
-                        return ttScore;
-                    } else if (ttFlag == LOWERBOUND) {
-                        alpha = std::max(alpha, ttScore);
-                    } else if (ttFlag == UPPERBOUND) {
-                        beta = std::min(beta, ttScore);
-                    }
-                    if (alpha >= beta) {
-                        return ttScore;
+        /*
+         * Scores every child of a depth 1 node from its changed squares instead of copying the board and
+         * scanning it: material only for negamax, material and piece-square tables for alpha beta. Children
+         * that take the lion win, bare lions draw, and monkey jumps and children that need a lion extension or
+         * could be in the tablebases are searched as usual.
+         */
+        int frontierSearch(const Board &board, const std::vector<std::string> &moves, int depth, int initDepth,
+                           int alpha, int beta, bool alphaBeta) {
+            FrontierBatch batch;
+            int baseMaterial, basePlacement;
+            buildFrontierBatch(board, moves, alphaBeta && depth != initDepth, batch, baseMaterial, basePlacement);
+            evaluateFrontierBatch(batch, frontierMaterial.data(), frontierPlacement.data(), baseMaterial,
+                                  basePlacement);
+
+            int sign = board.getToPlay() == 'w' ? 1 : -1;
+            int value = negINF;
+            for (int i = 0; i < batch.count; ++i) {
+                const std::string &m = moves[i];
+                int childVal;
+                if (batch.state[i] == 's') {
+                    Board nextState = board;
+                    nextState.makeMove(m);
+                    TRACE_MOVE(m);
+                    int extension = alphaBeta ? lionExtension(nextState, depth, initDepth) : 0;
+                    lionExtensions += extension;
+                    childVal = alphaBeta ? -AlphaBetaNegamax(nextState, depth - 1 + extension, initDepth, -beta, -alpha)
+                                         : -negamax(nextState, depth - 1, initDepth);
+                    lionExtensions -= extension;
+                } else {
+                    STAT_INC(nodes);
+                    STAT_INC(evaluations);
+                    if (batch.state[i] == 'w') {
+                        childVal = 10000;
+                    } else if (batch.state[i] == 'd' || (alphaBeta && frontierRepetition(board, batch, i))) {
+                        childVal = 0;
+                    } else {
+                        childVal = sign * (batch.material[i] + (alphaBeta ? batch.placement[i] : 0));
                     }
                 }
-            }
-
-            if (depth == 0 || board.isGameOver() != 'n') {
-                return boardEvaluation(board);
-            }
-            int value;
-
-            value = negINF;
-            auto moves = board.GenerateAllLegalMoves();
-            for (const auto &m: moves) {
-                alpha = std::max(value, alpha);
-                auto nextState = board;
-                nextState.makeMove(m);
-                int childVal = -AlphaBetaNegamaxWithTT(nextState, depth - 1, initDepth, -beta, -alpha);
-                localBestMove = m;
                 if (childVal > value) {
                     value = childVal;
                     if (depth == initDepth) {
                         bestMove = m;
                     }
                 }
-                alpha = std::max(alpha, value);
-                if (alpha >= beta) {
-                    break;
+                if (alphaBeta) {
+                    alpha = std::max(alpha, value);
+                    if (alpha >= beta) {
+                        STAT_CUTOFF(i == 0);
+                        break;
+                    }
                 }
             }
+            return value;
+        }
 
-            FLAG flag = EXACT;
-            if (value <= origAlpha)
-                flag = UPPERBOUND;
-            else if (value >= beta)
-                flag = LOWERBOUND;
 
-            auto newEntry = new HashEntry(depth, value, flag, localBestMove, toPlay);
-            storeEntry(board, newEntry);
+    public:
+        //Zobrist keys come from a fixed seed so book keys stay valid between runs
+        MiniMax() : mt(ZOBRIST_SEED) {
+            initZobristTable();
+            initFrontierTables();
+        }
 
-            return value;
+        ~MiniMax() {
+            setTracer(nullptr);
         }
 
-        int PVS(const Board &board, int depth, int initDepth, int alpha, int beta) {
-            if (depth == 0 || board.isGameOver() != 'n') {
-                return boardEvaluation(board);
+        //Keys of the game positions before the next root since the last capture or pawn move, oldest first
+        void setGameHistory(const std::vector<unsigned long long> &keys) {
+            keyHistory.clear();
+            repetitionFilter.fill(0);
+            for (auto key: keys) {
+                pushPosition(key);
             }
-            int value;
-            auto moves = board.GenerateAllLegalMoves();
-            for (int i = 0; i < moves.size(); ++i) {
-                std::string m = moves[i];
-                Board nextState = board;
-                nextState.makeMove(m);
-                if (i == 0) {
-                    value = -PVS(nextState, depth - 1, initDepth, -beta, -alpha);
+        }
 
-                } else {
-                    value = -PVS(nextState, depth - 1, initDepth, -alpha - 1, -alpha);
-                    if (alpha < value < beta) {
-                        value = -PVS(nextState, depth - 1, initDepth, -beta, -value);
-                    }
+        //Extends the depth 0 nodes of the alpha beta searches with a capture search
+        void setQuiescence(bool enabled) {
+            quiescenceSearch = enabled;
+        }
 
+        //The table move, captures that win or trade by static exchange (best first), quiet moves, losing captures
+        std::vector<std::string> orderMoves(const Board &board, const std::vector<std::string> &moves,
+                                            const std::string &ttMove) {
+            auto b = board.getBoard();
+            std::vector<std::pair<int, int>> keys;
+            keys.reserve(moves.size());
+            for (int i = 0; i < (int) moves.size(); ++i) {
+                const std::string &m = moves[i];
+                int key = 0;
+                if (m == ttMove) {
+                    key = INF;
+                } else if (getMoveTarget(b, m) != '_') {
+                    int see = staticExchange(board, m);
+                    key = see >= 0 ? 1000000 + see : -1000000 + see;
                 }
-                if (depth == initDepth)
-                    bestMove = m;
-                alpha = std::max(alpha, value);
-                if (alpha >= beta)
-                    break;
+                keys.emplace_back(key, i);
             }
-            return value;
+            std::stable_sort(keys.begin(), keys.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+                return a.first > b.first;
+            });
+            std::vector<std::string> ordered;
+            ordered.reserve(moves.size());
+            for (const auto &k: keys) {
+                ordered.push_back(moves[k.second]);
+            }
+            return ordered;
         }
 
-        std::string getBestMoveNegamax(const std::string &fen, int depth, int Mode) {
-            auto board = Board(fen);
-            int score = 0;
-            if (Mode == STANDARD)
-                score = negamax(board, depth, depth);
-            else if (Mode == ALPHA_BETA)
-                score = AlphaBetaNegamax(board, depth, depth, negINF, INF);
-            else if (Mode == TRANSPOSITION_TABLES)
-                score = AlphaBetaNegamaxWithTT(board, depth, depth, negINF, INF);
-            if (Mode == TRANSPOSITION_TABLES)
-                TranspositionTable.clear();
-            return bestMove;
+        //Scores the children of depth 1 nodes in negamax and AlphaBetaNegamax as one batch from their move deltas
+        void setFrontierBatching(bool enabled) {
+            frontierBatching = enabled;
         }
 
-        std::vector<std::string>
-        iterativeDeepeningOutput(const std::string &fen, int maxDepth, int Mode, int timeLimitSeconds) {
-            int searchDepth = 0;
-            startTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-            auto timeLimit = seconds_to_duration(timeLimitSeconds);
-            std::chrono::duration<double> totalTime = seconds_to_duration(0);
-            std::vector<std::string> stringArray;
+        void buildFrontierBatch(const Board &board, const std::vector<std::string> &moves, bool extensions,
+                                FrontierBatch &batch, int &baseMaterial, int &basePlacement) const {
+            auto b = board.getBoard();
+            char toPlay = board.getToPlay();
+            auto feature = [&](char piece, int square) {
+                return (int16_t) (pieceIndex(piece) * 49 + square);
+            };
+            auto isMine = [&](char piece) {
+                return piece != '_' && (toPlay == 'w' ? isupper(piece) : islower(piece));
+            };
+            baseMaterial = 0;
+            basePlacement = 0;
+            int others[2] = {0, 0};
+            int pieceCount = 0;
+            for (int i = 0; i < 49; ++i) {
+                if (b[i] != '_') {
+                    baseMaterial += frontierMaterial[feature(b[i], i)];
+                    basePlacement += frontierPlacement[feature(b[i], i)];
+                    others[isupper(b[i]) ? 0 : 1] += toupper(b[i]) != 'L';
+                    pieceCount++;
+                }
+            }
 
-            for (int i = 1; i <= maxDepth; ++i) {
+            batch.count = (int) moves.size();
+            for (int c = 0; c < batch.count; ++c) {
+                const std::string &m = moves[c];
+                int from = getIndexFromCoord(m.substr(0, 2));
+                int to = getIndexFromCoord(m.substr(m.size() - 2));
+                char piece = b[from], target = b[to];
+                bool drowns = from / 7 == 3 && to / 7 == 3 && toupper(piece) != 'C';
+                bool jump = toupper(piece) == 'M' && getMoveTarget(b, m) != '_';
+                int left[2] = {others[0], others[1]};
+                int removed = target != '_';
+                if (target != '_' && toupper(target) != 'L') {
+                    left[isupper(target) ? 0 : 1]--;
+                }
+                if (drowns) {
+                    left[isupper(piece) ? 0 : 1]--;
+                    removed++;
+                }
 
-                Board board = Board(fen);
-                int score = 0;
-                auto start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+                batch.before[0][c] = feature(piece, from);
+                batch.after[0][c] = feature('_', from);
+                batch.before[1][c] = feature(target, to);
+                batch.after[1][c] = feature(drowns ? '_' : piece, to);
+                int slot = 2;
+                for (int r = 21; r < 28; ++r) {
+                    if (r == from || r == to) {
+                        continue;
+                    }
+                    bool drowned = isMine(b[r]) && toupper(b[r]) != 'C';
+                    batch.before[slot][c] = feature(b[r], r);
+                    batch.after[slot][c] = drowned ? feature('_', r) : feature(b[r], r);
+                    if (drowned) {
+                        left[isupper(b[r]) ? 0 : 1]--;
+                        removed++;
+                    }
+                    slot++;
+                }
+                for (; slot < FRONTIER_CHANGES; ++slot) {
+                    batch.before[slot][c] = batch.after[slot][c] = feature('_', 0);
+                }
 
-                if (Mode == STANDARD)
-                    score = itNegamax(board, i, i, timeLimit);
-                else if (Mode == ALPHA_BETA)
-                    score = itAlphaBetaNegamax(board, i, i, negINF, INF, timeLimit);
-                else if (Mode == TRANSPOSITION_TABLES)
-                    score = itAlphaBetaNegamaxWithTT(board, i, i, negINF, INF, timeLimit);
-                auto end = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-                auto timeTaken = end - start;
+                bool attacksLion = false;
+                if (extensions && lionExtensions < MAX_LION_EXTENSIONS) {
+                    auto child = b;
+                    for (int j = 0; j < FRONTIER_CHANGES; ++j) {
+                        int square = batch.after[j][c] % 49;
+                        int p = batch.after[j][c] / 49;
+                        if (batch.before[j][c] != batch.after[j][c]) {
+                            child[square] = PieceChars[p];
+                        }
+                    }
+                    attacksLion = getLionAttackers(child, toPlay) != 0;
+                }
+                if (jump) {
+                    batch.state[c] = 's';
+                } else if (toupper(target) == 'L') {
+                    batch.state[c] = 'w';
+                } else if (attacksLion || (tablebases != nullptr && pieceCount - removed <= TB_MAX_PIECES)) {
+                    batch.state[c] = 's';
+                } else if (left[0] == 0 && left[1] == 0) {
+                    batch.state[c] = 'd';
+                } else {
+                    batch.state[c] = 'n';
+                }
+            }
+        }
 
-                totalTime += timeTaken;
+        void setOpeningBook(const OpeningBook *b) {
+            book = b;
+        }
 
-                if (LastCompletedDepth != i) {
-                    break;
-                }
+        void setTablebases(const Tablebases *tb) {
+            tablebases = tb;
+        }
 
-                stringArray.push_back("Depth: " + std::to_string(i) + "\n");
-                stringArray.push_back("Time: " + std::to_string(timeTaken.count()) + "\n");
-                stringArray.push_back("Best Move: " + bestMove + "\n");
-                stringArray.push_back("Score: " + std::to_string(score) + "\n");
-                stringArray.push_back("Last Completed Depth: " + std::to_string(LastCompletedDepth) + "\n\n");
+        //Per-iteration search statistics are written to out as JSON lines, nullptr turns them off
+        void setStatsOutput(std::ostream *out) {
+            statsOutput = out;
+        }
 
-                searchDepth = i;
-                DepthMoves[i] = std::make_pair(score, bestMove);
+        //boardEvaluation uses the network instead of the hand written terms, nullptr switches it off
+        void setNetwork(const NNUENetwork *net) {
+            network = net;
+        }
+
+        //The position a search starts from, carrying an accumulator when a network is set; its killer moves are
+        //forgotten
+        Board rootBoard(const Board &position) {
+            Board board = position;
+            if (board.getNetwork() != network) {
+                board.setNetwork(network);
             }
+            board.setReversibleMoves((int) keyHistory.size());
+            rootPly = (int) keyHistory.size();
+            for (auto &k: killers) {
+                k[0].clear();
+                k[1].clear();
+            }
+            return board;
+        }
 
+        //Plies from the root to the node being searched, before it pushes its own key
+        int searchPly() const {
+            return (int) keyHistory.size() - rootPly;
+        }
 
-            for (const auto &i: DepthMoves) {
-                stringArray.push_back(
-                        "Depth: " + std::to_string(i.first) + " Score: " + std::to_string(i.second.first) + " Move: " +
-                        i.second.second + "\n");
+        const std::string *killersAt(int ply) const {
+            return ply >= 0 && ply < MAX_KILLER_PLY ? killers[ply].data() : nullptr;
+        }
+
+        //Quiet moves that caused a beta cutoff, the latest first, are tried early at the same ply elsewhere
+        void updateKillers(const Board &board, const std::string &move, int ply) {
+            if (ply < 0 || ply >= MAX_KILLER_PLY || killers[ply][0] == move ||
+                getMoveTarget(board.getBoard(), move) != '_') {
+                return;
             }
-            stringArray.push_back("Total Time: " + std::to_string(totalTime.count()) + "\n");
-            if (Mode == TRANSPOSITION_TABLES)
-                TranspositionTable.clear();
-            return stringArray;
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
         }
 
-        std::string
-        iterativeDeepening(const std::string &fen, int maxDepth, int Mode, int timeLimitSeconds) {
-            int searchDepth = 0;
-            startTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-            auto timeLimit = seconds_to_duration(timeLimitSeconds);
-            std::chrono::duration<double> totalTime = seconds_to_duration(0);
-            for (int i = 1; i <= maxDepth; ++i) {
-                Board board = Board(fen);
-                int score = 0;
-                auto start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+        void pushPosition(unsigned long long key) {
+            keyHistory.push_back(key);
+            repetitionFilter[key & (REPETITION_FILTER_SIZE - 1)]++;
+        }
 
-                if (Mode == STANDARD)
-                    score = itNegamax(board, i, i, timeLimit);
-                else if (Mode == ALPHA_BETA)
-                    score = itAlphaBetaNegamax(board, i, i, negINF, INF, timeLimit);
-                else if (Mode == TRANSPOSITION_TABLES)
-                    score = itAlphaBetaNegamaxWithTT(board, i, i, negINF, INF, timeLimit);
-                auto end = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-                auto timeTaken = end - start;
+        void popPosition() {
+            repetitionFilter[keyHistory.back() & (REPETITION_FILTER_SIZE - 1)]--;
+            keyHistory.pop_back();
+        }
 
-                totalTime += timeTaken;
+        /*
+         * True when key occurred earlier in the game or on the search path. Only every second position of the
+         * reversible window can match, and the filter of key counts rules out almost every node before that.
+         */
+        bool isRepetition(const Board &board, unsigned long long key) const {
+            return isRepetition(board.getReversibleMoves(), key);
+        }
 
-                if (LastCompletedDepth != i) {
-                    break;
+        //The same for a position reversibleMoves plies into its window
+        bool isRepetition(int reversibleMoves, unsigned long long key) const {
+            if (repetitionFilter[key & (REPETITION_FILTER_SIZE - 1)] == 0) {
+                return false;
+            }
+            int n = (int) keyHistory.size();
+            int window = std::min(reversibleMoves, n);
+            for (int i = 4; i <= window; i += 2) {
+                if (keyHistory[n - i] == key) {
+                    return true;
                 }
+            }
+            return false;
+        }
 
-                DepthMoves[i] = std::make_pair(score, bestMove);
+        //Network score for the side to move; boards from elsewhere get a fresh accumulator
+        int nnueEvaluation(const Board &board) const {
+            if (board.getNetwork() == network) {
+                return evaluateAccumulator(*network, board.getAccumulator(), board.getToPlay());
             }
-            if (Mode == TRANSPOSITION_TABLES)
-                TranspositionTable.clear();
-            return DepthMoves[LastCompletedDepth].second;
+            NNUEAccumulator accumulator;
+            refreshAccumulator(*network, accumulator, board.getBoard());
+            return evaluateAccumulator(*network, accumulator, board.getToPlay());
         }
 
+        //Iterative deepening searches give up once the flag is set, e.g. from another thread
+        void setStopFlag(const std::atomic<bool> *flag) {
+            stopFlag = flag;
+        }
 
-        int itNegamax(const Board &board, int depth, int initDepth, std::chrono::duration<double> timeLimit) {
-            auto currTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-            if (currTime - startTime >= timeLimit) {
-                LastCompletedDepth = initDepth - 1;
-                return -INF;
+        //Called after every completed depth of iterativeDeepeningMultiPV with the depth, best line, nodes and seconds
+        void setInfoCallback(std::function<void(int, const PVLine &, unsigned long long, double)> callback) {
+            infoCallback = std::move(callback);
+        }
+
+        //The counters with the thread's allocations so far, so the difference of two covers a search
+        SearchStats statsSnapshot() const {
+            SearchStats snapshot = stats;
+            snapshot.allocations = getAllocationCount();
+            snapshot.allocatedBytes = getAllocatedBytes();
+            return snapshot;
+        }
+
+        //Also writes the phase costs since the last report and hands the trace of the finished search to the tracer
+        void reportStats(const std::string &source, int depth, double seconds, int score, const SearchStats &s,
+                         unsigned long long previousNodes) {
+            if (statsOutput != nullptr) {
+                *statsOutput << s.toJson(source, depth, seconds, bestMove, score, previousNodes) << std::endl;
             }
-            if (depth <= 0 || board.isGameOver() != 'n') {
-                LastCompletedDepth = initDepth;
-                return BasicBoardEvaluation(board);
+            if (profiler != nullptr) {
+                std::array<PhaseCounters, PhaseCount> phases = profiler->getPhases();
+                for (int p = 0; p < PhaseCount; ++p) {
+                    phases[p] = phases[p] - reportedPhases[p];
+                }
+                reportedPhases = profiler->getPhases();
+                if (statsOutput != nullptr) {
+                    *statsOutput << "{\"source\":\"" << source << "\",\"depth\":" << depth << ",\"phases\":"
+                                 << phasesJson(phases, profiler->available()) << "}" << std::endl;
+                }
             }
-            int value = negINF;
-            auto moves = board.GenerateAllLegalMoves();
+#ifdef CONGO_TRACE
+            flushTrace();
+#endif
+        }
 
-            for (const auto &m: moves) {
-                Board nextState = board;
-                nextState.makeMove(m);
-                int childVal = -itNegamax(nextState, depth - 1, initDepth, timeLimit);
-                if (childVal > value) {
-                    value = childVal;
-                    if (depth == initDepth)
-                        bestMove = m;
-                }
+        //Charges the phases of this MiniMax's searches to profiler (builds with -DCONGO_PERF), nullptr stops
+        void setProfiler(PhaseProfiler *p) {
+            profiler = p;
+            reportedPhases = p != nullptr ? p->getPhases() : std::array<PhaseCounters, PhaseCount>{};
+        }
+
+        //Records the searches in tracer's file when built with -DCONGO_TRACE, nullptr stops recording
+        void setTracer(SearchTracer *t) {
+#ifdef CONGO_TRACE
+            flushTrace();
+            tracer = t;
+            traceRing.resize(t != nullptr ? TRACE_RING_EVENTS : 0);
+            traceSearcher = t != nullptr ? t->addSearcher() : 0;
+            traceCountdown = 1;
+            traceNodes = 0;
+            traceCurrent = 0;
+            traceSampled = false;
+#else
+            (void) t;
+#endif
+        }
+
+        //Wins on the spot when the side to move can take the opposing lion, without generating moves
+        bool findLionCapture(const Board &board, std::string &move) const {
+            auto b = board.getBoard();
+            unsigned long long attackers = getLionAttackers(b, board.getToPlay());
+            if (attackers == 0) {
+                return false;
             }
-            return value;
+            int lion = getSinglePiecePos(b, setPieceCase(flipColour(board.getToPlay()), 'l'));
+            int from = __builtin_ctzll(attackers);
+            //A monkey takes by jumping over the lion to the square behind it
+            move = getCoordFromIndex(from) + getCoordFromIndex(toupper(b[from]) == 'M' ? 2 * lion - from : lion);
+            return true;
         }
 
-        int itAlphaBetaNegamax(const Board &board, int depth, int initDepth, int alpha, int beta,
-                               std::chrono::duration<double> timeLimit) {
-            auto currTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-            if (currTime - startTime >= timeLimit) {
-                LastCompletedDepth = initDepth - 1;
-                return -INF;
+        //One extra ply for a move that leaves the opposing lion attacked, so the threat is searched to its end
+        int lionExtension(const Board &child, int depth, int initDepth) const {
+            if (depth == initDepth || lionExtensions >= MAX_LION_EXTENSIONS) {
+                return 0;
             }
-            if (depth == 0 || board.isGameOver() != 'n') {
-                LastCompletedDepth = initDepth;
-                return boardEvaluation(board);
+            return getLionAttackers(child.getBoard(), flipColour(child.getToPlay())) != 0 ? 1 : 0;
+        }
+
+        bool probeTablebases(const Board &board, int &score) const {
+            return tablebases != nullptr && tablebases->probe(board.getBoard(), board.getToPlay(), score);
+        }
+
+        unsigned long long int computeHash(std::array<char, 49> board) {
+            unsigned long long int h = 0;
+            for (int i = 0; i < board.size(); ++i) {
+                if (board[i] != '_') {
+                    h ^= ZobristTable[i][pieceIndex(board[i])];
+                }
+            }
+            return h;
+        }
+
+        //Hash of the position including the side to move
+        unsigned long long int positionKey(const Board &board) {
+            unsigned long long int h = computeHash(board.getBoard());
+            if (board.getToPlay() == 'b') {
+                h ^= ZobristBlackToMove;
             }
+            return h;
+        }
 
-            int value = negINF;
+        std::string getBookMove(const Board &board) {
+            if (book == nullptr || !book->isOpen()) {
+                return "";
+            }
+            std::string move = book->probe(board, positionKey(board), bookGen);
+            if (move.empty()) {
+                return "";
+            }
             auto moves = board.GenerateAllLegalMoves();
-            for (const auto &m: moves) {
-                Board nextState = board;
-                nextState.makeMove(m);
-                int childVal = -itAlphaBetaNegamax(nextState, depth - 1, initDepth, -beta, -alpha, timeLimit);
-                if (childVal > value) {
-                    value = childVal;
-                    if (depth == initDepth) {
-                        bestMove = m;
-                    }
-                }
-                alpha = std::max(alpha, value);
-                if (alpha >= beta) {
-                    break;
+            if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+                return "";
+            }
+            return move;
+        }
+
+        int negINF = -10000000;
+        int INF = 10000000;
+        std::map<int, std::pair<int, std::string>> DepthMoves;
+        std::map<int, std::vector<PVLine>> DepthMultiPV;
+        SearchStats stats;
+        std::array<std::array<unsigned long long int, PieceCount>, 49> ZobristTable{};
+
+
+        int BasicBoardEvaluation(const Board &board) {
+            PHASE_SCOPE(PhaseEval);
+            STAT_INC(evaluations);
+            int eval;
+            int factor = 1;
+            char toPlay = board.getToPlay();
+            if (toPlay == 'b') {
+                factor = -1;
+            }
+
+            char winner = board.isGameOver();
+            if (winner == 'w') {
+                return factor * 10000;
+            }
+            if (winner == 'b') {
+                return factor * -10000;
+            }
+
+
+            std::string whitePieces = board.getPieceString('w');
+            std::string blackPieces = board.getPieceString('b');
+
+            if (whitePieces == "L" && blackPieces == "l") {
+                return 0;
+            }
+
+            //Piece Value
+            int wTotal = 0;
+            int bTotal = 0;
+            int total = 0;
+            for (auto i: whitePieces) {
+                wTotal += PieceValues[pieceIndex(i)];
+            }
+            for (auto i: blackPieces) {
+                bTotal += PieceValues[pieceIndex(i)];
+            }
+            eval = (wTotal - bTotal);
+
+
+
+
+            /* auto x = board.getPiecePositions();
+             for (const auto &i: x) {
+                 auto table = PieceSquareTables[i.first];
+                 for (auto j: i.second) {
+                     eval += table[j];
+                 }
+             }*/
+            return factor * eval;
+        }
+
+
+        int boardEvaluation(const Board &board) {
+            PHASE_SCOPE(PhaseEval);
+            STAT_INC(evaluations);
+            int eval;
+            int factor = 1;
+            char toPlay = board.getToPlay();
+            if (toPlay == 'b') {
+                factor = -1;
+            }
+
+            char winner = board.isGameOver();
+            if (winner == 'w') {
+                return factor * 10000;
+            }
+            if (winner == 'b') {
+                return factor * -10000;
+            }
+
+            int tbScore;
+            if (probeTablebases(board, tbScore)) {
+                return tbScore;
+            }
+
+            std::string whitePieces = board.getPieceString('w');
+            std::string blackPieces = board.getPieceString('b');
+
+            if (whitePieces == "L" && blackPieces == "l") {
+                return 0;
+            }
+
+            if (network != nullptr) {
+                return nnueEvaluation(board);
+            }
+
+            //Piece Value
+            int wTotal = 0;
+            int bTotal = 0;
+            int total = 0;
+            for (auto i: whitePieces) {
+                wTotal += PieceValues[pieceIndex(i)];
+            }
+            for (auto i: blackPieces) {
+                bTotal += PieceValues[pieceIndex(i)];
+            }
+            eval = (wTotal - bTotal);
+
+            //Piece-square tables
+            auto squares = board.getBoard();
+            for (int i = 0; i < 49; ++i) {
+                if (squares[i] != '_') {
+                    int value = PieceSquareTables[pieceIndex(squares[i])][i];
+                    eval += isupper(squares[i]) ? value : -value;
                 }
             }
 
-            return value;
+            Board oppBoard = board;
+            oppBoard.flipToPlay();
+
+            //Mobility Score
+            auto oppMoves = oppBoard.GenerateAllLegalMoves();
+            auto myMoves = board.GenerateAllLegalMoves();
+            if (toPlay == 'w') {
+                eval += MobilityWeight * (int) (myMoves.size() - oppMoves.size());
+            } else {
+                eval += MobilityWeight * (int) (oppMoves.size() - myMoves.size());
+            }
+
+            //Attacking Score
+            int wAttackTotal = 0;
+            int bAttackTotal = 0;
+            auto myBoardArr = board.getBoard();
+            for (const auto &m: myMoves) {
+                char desPieces = getMoveTarget(myBoardArr, m);
+                if (toPlay == 'w') {
+                    if (islower(desPieces)) {
+                        wAttackTotal += AttackWeight;
+                        if (desPieces == 'l') {
+                            wAttackTotal += LionAttackWeight;
+                        }
+                    }
+                } else {
+                    if (isupper(desPieces)) {
+                        bAttackTotal += AttackWeight;
+                        if (desPieces == 'L') {
+                            bAttackTotal += LionAttackWeight;
+                        }
+                    }
+                }
+            }
+            auto oppBoardArr = board.getBoard();
+            for (const auto &m: oppMoves) {
+                char desPieces = getMoveTarget(myBoardArr, m);
+                if (toPlay == 'b') {
+                    if (islower(desPieces)) {
+                        wAttackTotal += AttackWeight;
+                        if (desPieces == 'l') {
+                            wAttackTotal += LionAttackWeight;
+                        }
+                    }
+                } else {
+                    if (isupper(desPieces)) {
+                        bAttackTotal += AttackWeight;
+                        if (desPieces == 'L') {
+                            bAttackTotal += LionAttackWeight;
+                        }
+                    }
+                }
+            }
+            eval += wAttackTotal - bAttackTotal;
+
+
+            return factor * eval;
+        }
+
+        int negamax(const Board &board, int depth, int initDepth) {
+            STAT_INC(nodes);
+            if (depth <= 0 || board.isGameOver() != 'n') {
+                return BasicBoardEvaluation(board);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+            int value = negINF;
+            auto moves = board.GenerateAllLegalMoves();
+            if (depth == 1 && useFrontierBatch(moves)) {
+                return frontierSearch(board, moves, depth, initDepth, negINF, INF, false);
+            }
+            for (const auto &m: moves) {
+                Board nextState = board;
+                nextState.makeMove(m);
+                int childVal = -negamax(nextState, depth - 1, initDepth);
+                if (childVal > value) {
+                    value = childVal;
+                    if (depth == initDepth)
+                        bestMove = m;
+                }
+            }
+            return value;
+        }
+
+        int AlphaBetaNegamax(const Board &board, int depth, int initDepth, int alpha, int beta) {
+            return traceNode(depth, alpha, beta, [&]() {
+                return searchAlphaBeta(board, depth, initDepth, alpha, beta);
+            });
+        }
+
+        int searchAlphaBeta(const Board &board, int depth, int initDepth, int alpha, int beta) {
+            STAT_INC(nodes);
+            unsigned long long key = positionKey(board);
+            if (depth != initDepth && isRepetition(board, key)) {
+                return 0;
+            }
+            if (depth == 0 || board.isGameOver() != 'n') {
+                return leafEvaluation(board, depth, alpha, beta);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+            int value = negINF;
+
+            pushPosition(key);
+            if (depth == 1 && frontierBatching) {
+                auto moves = orderMoves(board, board.GenerateAllLegalMoves(), "");
+                if (useFrontierBatch(moves)) {
+                    value = frontierSearch(board, moves, depth, initDepth, alpha, beta, true);
+                    popPosition();
+                    return value;
+                }
+            }
+            int ply = searchPly();
+            MovePicker picker(board, "", killersAt(ply), false);
+            while (const std::string *next = picker.next()) {
+                const std::string &m = *next;
+                Board nextState = board;
+                nextState.makeMove(m);
+                TRACE_MOVE(m);
+                int extension = lionExtension(nextState, depth, initDepth);
+                lionExtensions += extension;
+                int childVal = -AlphaBetaNegamax(nextState, depth - 1 + extension, initDepth, -beta, -alpha);
+                lionExtensions -= extension;
+                if (childVal > value) {
+                    value = childVal;
+                    if (depth == initDepth) {
+                        bestMove = m;
+                    }
+                }
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    STAT_CUTOFF(picker.count() == 1);
+                    TRACE_EVENT(TraceCutoff, depth, alpha, beta, value, encodeMove(m), picker.count());
+                    updateKillers(board, m, ply);
+                    break;
+                }
+            }
+            popPosition();
+            return value;
+        }
+
+        int AlphaBetaNegamaxWithTT(const Board &board, int depth, int initDepth, int alpha, int beta) {
+            return traceNode(depth, alpha, beta, [&]() {
+                return searchAlphaBetaWithTT(board, depth, initDepth, alpha, beta);
+            });
+        }
+
+        int searchAlphaBetaWithTT(const Board &board, int depth, int initDepth, int alpha, int beta) {
+            STAT_INC(nodes);
+            unsigned long long key = positionKey(board);
+            if (depth != initDepth && isRepetition(board, key)) {
+                return 0;
+            }
+            int origAlpha = alpha;
+            const HashEntry *entry = GetTranspositionEntry(board);
+            int ttDepth = -1;
+            std::string ttMove, localBestMove;
+            FLAG ttFlag;
+            int ttScore;
+            if (entry != nullptr) {
+                ttDepth = entry->depth;
+                ttMove = entry->move != 0 ? decodeTableMove(board.getBoard(), board.getToPlay(), entry->move) : "";
+                TRACE_EVENT(TraceHit, entry->depth, entry->flag, 0, entry->score,
+                            ttMove.empty() ? 0 : encodeMove(ttMove), key);
+                ttFlag = (FLAG) entry->flag;
+                ttScore = entry->score;
+                if (ttDepth >= depth && ttDepth != initDepth && depth != initDepth) {
+
+                    if (ttFlag == EXACT) {
+                        STAT_INC(ttCutoffs);
+                        return ttScore;
+                    } else if (ttFlag == LOWERBOUND) {
+                        alpha = std::max(alpha, ttScore);
+                    } else if (ttFlag == UPPERBOUND) {
+                        beta = std::min(beta, ttScore);
+                    }
+                    if (alpha >= beta) {
+                        STAT_INC(ttCutoffs);
+                        return ttScore;
+                    }
+                }
+            }
+
+            int tbScore;
+            if (depth != initDepth && probeTablebases(board, tbScore)) {
+                return tbScore;
+            }
+
+            if (depth == 0 || board.isGameOver() != 'n') {
+                return leafEvaluation(board, depth, alpha, beta);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+            int value;
+
+            value = negINF;
+            int ply = searchPly();
+            MovePicker picker(board, ttMove, killersAt(ply), false);
+            pushPosition(key);
+            while (const std::string *next = picker.next()) {
+                const std::string &m = *next;
+                alpha = std::max(value, alpha);
+                auto nextState = board;
+                nextState.makeMove(m);
+                TRACE_MOVE(m);
+                int extension = lionExtension(nextState, depth, initDepth);
+                lionExtensions += extension;
+                int childVal = -AlphaBetaNegamaxWithTT(nextState, depth - 1 + extension, initDepth, -beta, -alpha);
+                lionExtensions -= extension;
+                if (childVal > value) {
+                    value = childVal;
+                    localBestMove = m;
+                    if (depth == initDepth) {
+                        bestMove = m;
+                    }
+                }
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    STAT_CUTOFF(picker.count() == 1);
+                    TRACE_EVENT(TraceCutoff, depth, alpha, beta, value, encodeMove(m), picker.count());
+                    updateKillers(board, m, ply);
+                    break;
+                }
+            }
+            popPosition();
+
+            FLAG flag = EXACT;
+            if (value <= origAlpha)
+                flag = UPPERBOUND;
+            else if (value >= beta)
+                flag = LOWERBOUND;
+
+            storeEntry(board, depth, value, flag, localBestMove);
+
+            return value;
+        }
+
+        int PVS(const Board &board, int depth, int initDepth, int alpha, int beta) {
+            STAT_INC(nodes);
+            if (depth == 0 || board.isGameOver() != 'n') {
+                return boardEvaluation(board);
+            }
+            int value;
+            auto moves = board.GenerateAllLegalMoves();
+            for (int i = 0; i < moves.size(); ++i) {
+                std::string m = moves[i];
+                Board nextState = board;
+                nextState.makeMove(m);
+                if (i == 0) {
+                    value = -PVS(nextState, depth - 1, initDepth, -beta, -alpha);
+
+                } else {
+                    value = -PVS(nextState, depth - 1, initDepth, -alpha - 1, -alpha);
+                    if (alpha < value < beta) {
+                        value = -PVS(nextState, depth - 1, initDepth, -beta, -value);
+                    }
+
+                }
+                if (depth == initDepth)
+                    bestMove = m;
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    STAT_CUTOFF(i == 0);
+                    break;
+                }
+            }
+            return value;
+        }
+
+        std::string getBestMoveNegamax(const std::string &fen, int depth, int Mode) {
+            return getBestMoveNegamax(Board(fen), depth, Mode);
+        }
+
+        std::string getBestMoveNegamax(const Board &position, int depth, int Mode) {
+            ProfilerBinding binding(profiler);
+            auto board = rootBoard(position);
+            std::string bookMove = getBookMove(board);
+            if (!bookMove.empty()) {
+                bestMove = bookMove;
+                lastScore = 0;
+                return bestMove;
+            }
+            int score = 0;
+            SearchStats before = statsSnapshot();
+            auto start = std::chrono::steady_clock::now();
+            if (Mode == STANDARD)
+                score = negamax(board, depth, depth);
+            else if (Mode == ALPHA_BETA)
+                score = AlphaBetaNegamax(board, depth, depth, negINF, INF);
+            else if (Mode == TRANSPOSITION_TABLES)
+                score = AlphaBetaNegamaxWithTT(board, depth, depth, negINF, INF);
+            std::chrono::duration<double> timeTaken = std::chrono::steady_clock::now() - start;
+            reportStats("getBestMoveNegamax", depth, timeTaken.count(), score, statsSnapshot() - before, 0);
+            lastScore = score;
+            return bestMove;
+        }
+
+        std::vector<std::string>
+        iterativeDeepeningOutput(const std::string &fen, int maxDepth, int Mode, int timeLimitSeconds) {
+            return iterativeDeepeningOutput(Board(fen), maxDepth, Mode, (double) timeLimitSeconds);
+        }
+
+        std::vector<std::string>
+        iterativeDeepeningOutput(const Board &position, int maxDepth, int Mode, double timeLimitSeconds) {
+            ProfilerBinding binding(profiler);
+            std::string bookMove = getBookMove(position);
+            if (!bookMove.empty()) {
+                bestMove = bookMove;
+                lastScore = 0;
+                return {"Book Move: " + bookMove + "\n"};
+            }
+            int searchDepth = 0;
+            startTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+            nodeCount = 0;
+            aborted = false;
+            auto timeLimit = seconds_to_duration(timeLimitSeconds);
+            std::chrono::duration<double> totalTime = seconds_to_duration(0);
+            std::vector<std::string> stringArray;
+            Board board = rootBoard(position);
+
+            for (int i = 1; i <= maxDepth; ++i) {
+                int score = 0;
+                auto start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+
+                if (Mode == STANDARD)
+                    score = itNegamax(board, i, i, timeLimit);
+                else if (Mode == ALPHA_BETA)
+                    score = itAlphaBetaNegamax(board, i, i, negINF, INF, timeLimit);
+                else if (Mode == TRANSPOSITION_TABLES)
+                    score = itAlphaBetaNegamaxWithTT(board, i, i, negINF, INF, timeLimit);
+                LastCompletedDepth = aborted ? i - 1 : i;
+                auto end = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+                auto timeTaken = end - start;
+
+                totalTime += timeTaken;
+
+                if (LastCompletedDepth != i) {
+                    break;
+                }
+
+                stringArray.push_back("Depth: " + std::to_string(i) + "\n");
+                stringArray.push_back("Time: " + std::to_string(timeTaken.count()) + "\n");
+                stringArray.push_back("Best Move: " + bestMove + "\n");
+                stringArray.push_back("Score: " + std::to_string(score) + "\n");
+                stringArray.push_back("Last Completed Depth: " + std::to_string(LastCompletedDepth) + "\n\n");
+
+                searchDepth = i;
+                DepthMoves[i] = std::make_pair(score, bestMove);
+            }
+
+
+            for (const auto &i: DepthMoves) {
+                stringArray.push_back(
+                        "Depth: " + std::to_string(i.first) + " Score: " + std::to_string(i.second.first) + " Move: " +
+                        i.second.second + "\n");
+            }
+            stringArray.push_back("Total Time: " + std::to_string(totalTime.count()) + "\n");
+            return stringArray;
+        }
+
+        std::string
+        iterativeDeepening(const std::string &fen, int maxDepth, int Mode, int timeLimitSeconds) {
+            return iterativeDeepening(Board(fen), maxDepth, Mode, (double) timeLimitSeconds);
+        }
+
+        std::string iterativeDeepening(const Board &position, int maxDepth, int Mode, double timeLimitSeconds) {
+            ProfilerBinding binding(profiler);
+            std::string bookMove = getBookMove(position);
+            if (!bookMove.empty()) {
+                bestMove = bookMove;
+                lastScore = 0;
+                return bestMove;
+            }
+            int searchDepth = 0;
+            startTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+            nodeCount = 0;
+            aborted = false;
+            auto timeLimit = seconds_to_duration(timeLimitSeconds);
+            std::chrono::duration<double> totalTime = seconds_to_duration(0);
+            unsigned long long previousNodes = 0;
+            Board board = rootBoard(position);
+            for (int i = 1; i <= maxDepth; ++i) {
+                int score = 0;
+                SearchStats before = statsSnapshot();
+                auto start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+
+                if (Mode == STANDARD)
+                    score = itNegamax(board, i, i, timeLimit);
+                else if (Mode == ALPHA_BETA)
+                    score = itAlphaBetaNegamax(board, i, i, negINF, INF, timeLimit);
+                else if (Mode == TRANSPOSITION_TABLES)
+                    score = itAlphaBetaNegamaxWithTT(board, i, i, negINF, INF, timeLimit);
+                LastCompletedDepth = aborted ? i - 1 : i;
+                auto end = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+                auto timeTaken = end - start;
+
+                totalTime += timeTaken;
+
+                if (LastCompletedDepth != i) {
+                    break;
+                }
+
+                SearchStats iteration = statsSnapshot() - before;
+                reportStats("iterativeDeepening", i, timeTaken.count(), score, iteration, previousNodes);
+                previousNodes = iteration.nodes;
+                DepthMoves[i] = std::make_pair(score, bestMove);
+            }
+            lastScore = DepthMoves[LastCompletedDepth].first;
+            return DepthMoves[LastCompletedDepth].second;
+        }
+
+
+        int itNegamax(const Board &board, int depth, int initDepth, std::chrono::duration<double> timeLimit) {
+            STAT_INC(nodes);
+            if (budgetExhausted(initDepth, timeLimit)) {
+                LastCompletedDepth = initDepth - 1;
+                return -INF;
+            }
+            if (depth <= 0 || board.isGameOver() != 'n') {
+                LastCompletedDepth = initDepth;
+                return BasicBoardEvaluation(board);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                LastCompletedDepth = initDepth;
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+            int value = negINF;
+            auto moves = board.GenerateAllLegalMoves();
+
+            for (const auto &m: moves) {
+                Board nextState = board;
+                nextState.makeMove(m);
+                int childVal = -itNegamax(nextState, depth - 1, initDepth, timeLimit);
+                if (childVal > value) {
+                    value = childVal;
+                    if (depth == initDepth)
+                        bestMove = m;
+                }
+            }
+            return value;
+        }
+
+        int itAlphaBetaNegamax(const Board &board, int depth, int initDepth, int alpha, int beta,
+                               std::chrono::duration<double> timeLimit) {
+            return traceNode(depth, alpha, beta, [&]() {
+                return searchItAlphaBeta(board, depth, initDepth, alpha, beta, timeLimit);
+            });
+        }
+
+        int searchItAlphaBeta(const Board &board, int depth, int initDepth, int alpha, int beta,
+                              std::chrono::duration<double> timeLimit) {
+            STAT_INC(nodes);
+            if (budgetExhausted(initDepth, timeLimit)) {
+                LastCompletedDepth = initDepth - 1;
+                return -INF;
+            }
+            unsigned long long key = positionKey(board);
+            if (depth != initDepth && isRepetition(board, key)) {
+                return 0;
+            }
+            if (depth == 0 || board.isGameOver() != 'n') {
+                LastCompletedDepth = initDepth;
+                return leafEvaluation(board, depth, alpha, beta);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove)) {
+                LastCompletedDepth = initDepth;
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+
+            int value = negINF;
+            int ply = searchPly();
+            MovePicker picker(board, "", killersAt(ply), false);
+            pushPosition(key);
+            while (const std::string *next = picker.next()) {
+                const std::string &m = *next;
+                Board nextState = board;
+                nextState.makeMove(m);
+                TRACE_MOVE(m);
+                int extension = lionExtension(nextState, depth, initDepth);
+                lionExtensions += extension;
+                int childVal = -itAlphaBetaNegamax(nextState, depth - 1 + extension, initDepth, -beta, -alpha, timeLimit);
+                lionExtensions -= extension;
+                if (childVal > value) {
+                    value = childVal;
+                    if (depth == initDepth) {
+                        bestMove = m;
+                    }
+                }
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    STAT_CUTOFF(picker.count() == 1);
+                    TRACE_EVENT(TraceCutoff, depth, alpha, beta, value, encodeMove(m), picker.count());
+                    updateKillers(board, m, ply);
+                    break;
+                }
+            }
+            popPosition();
+
+            return value;
+        }
+
+        int itAlphaBetaNegamaxWithTT(const Board &board, int depth, int initDepth, int alpha, int beta,
+                                     std::chrono::duration<double> timeLimit) {
+            return traceNode(depth, alpha, beta, [&]() {
+                return searchItAlphaBetaWithTT(board, depth, initDepth, alpha, beta, timeLimit);
+            });
+        }
+
+        int searchItAlphaBetaWithTT(const Board &board, int depth, int initDepth, int alpha, int beta,
+                                    std::chrono::duration<double> timeLimit) {
+            STAT_INC(nodes);
+            if (budgetExhausted(initDepth, timeLimit)) {
+                LastCompletedDepth = initDepth - 1;
+                return -INF;
+            }
+            unsigned long long key = positionKey(board);
+            if (depth != initDepth && isRepetition(board, key)) {
+                return 0;
+            }
+
+            int origAlpha = alpha;
+            const HashEntry *entry = GetTranspositionEntry(board);
+            int ttDepth = -1;
+            std::string ttMove, localBestMove;
+            FLAG ttFlag;
+            int ttScore;
+            if (entry != nullptr) {
+                ttDepth = entry->depth;
+                ttMove = entry->move != 0 ? decodeTableMove(board.getBoard(), board.getToPlay(), entry->move) : "";
+                TRACE_EVENT(TraceHit, entry->depth, entry->flag, 0, entry->score,
+                            ttMove.empty() ? 0 : encodeMove(ttMove), key);
+                ttFlag = (FLAG) entry->flag;
+                ttScore = entry->score;
+                if (ttDepth >= depth && ttDepth != initDepth && depth != initDepth) {
+
+                    if (ttFlag == EXACT) {
+                        STAT_INC(ttCutoffs);
+                        return ttScore;
+                    } else if (ttFlag == LOWERBOUND) {
+                        alpha = std::max(alpha, ttScore);
+                    } else if (ttFlag == UPPERBOUND) {
+                        beta = std::min(beta, ttScore);
+                    }
+                    if (alpha >= beta) {
+                        STAT_INC(ttCutoffs);
+                        return ttScore;
+                    }
+                }
+
+            }
+
+            int tbScore;
+            if (depth != initDepth && probeTablebases(board, tbScore)) {
+                LastCompletedDepth = initDepth;
+                return tbScore;
+            }
+
+            if (depth == 0 || board.isGameOver() != 'n') {
+                LastCompletedDepth = initDepth;
+                return leafEvaluation(board, depth, alpha, beta);
+            }
+            std::string captureMove;
+            if (findLionCapture(board, captureMove) &&
+                !(depth == initDepth && excludedRootMoves.count(captureMove))) {
+                LastCompletedDepth = initDepth;
+                if (depth == initDepth) {
+                    bestMove = captureMove;
+                }
+                return 10000;
+            }
+            int value;
+
+            value = negINF;
+            int ply = searchPly();
+            MovePicker picker(board, ttMove, killersAt(ply), false);
+            pushPosition(key);
+
+            while (const std::string *next = picker.next()) {
+                const std::string &m = *next;
+                if (depth == initDepth && excludedRootMoves.count(m)) {
+                    continue;
+                }
+                alpha = std::max(value, alpha);
+                auto nextState = board;
+                nextState.makeMove(m);
+                TRACE_MOVE(m);
+                int extension = lionExtension(nextState, depth, initDepth);
+                lionExtensions += extension;
+                int childVal = -itAlphaBetaNegamaxWithTT(nextState, depth - 1 + extension, initDepth, -beta, -alpha, timeLimit);
+                lionExtensions -= extension;
+                if (childVal > value) {
+                    value = childVal;
+                    localBestMove = m;
+                    if (depth == initDepth) {
+                        bestMove = m;
+                    }
+                }
+                alpha = std::max(alpha, value);
+                if (alpha >= beta) {
+                    STAT_CUTOFF(picker.count() == 1);
+                    TRACE_EVENT(TraceCutoff, depth, alpha, beta, value, encodeMove(m), picker.count());
+                    updateKillers(board, m, ply);
+                    break;
+                }
+            }
+            popPosition();
+
+            FLAG flag = EXACT;
+            if (value <= origAlpha)
+                flag = UPPERBOUND;
+            else if (value >= beta)
+                flag = LOWERBOUND;
+
+            if (!aborted) {
+                storeEntry(board, depth, value, flag, localBestMove);
+            }
+
+
+            return value;
+        }
+
+        std::string getBestMove() {
+            return bestMove;
+        }
+
+        //Stops iterative deepening searches after this many nodes, 0 for no limit
+        void setNodeLimit(unsigned long long limit) {
+            nodeLimit = limit;
+        }
+
+        //Nodes visited by the last iterative deepening search
+        unsigned long long getNodeCount() const {
+            return nodeCount;
+        }
+
+        //Score of the last getBestMoveNegamax or iterativeDeepening call, for the side that was to move
+        int getLastScore() const {
+            return lastScore;
+        }
+
+        //Follows the transposition table moves after firstMove, stopping at the first illegal or repeated one
+        std::vector<std::string> getPrincipalVariation(const Board &board, const std::string &firstMove, int maxLength) {
+            std::vector<std::string> pv;
+            std::set<unsigned long long int> visited;
+            Board current = board;
+            std::string move = firstMove;
+            while (!move.empty() && (int) pv.size() < maxLength) {
+                auto moves = current.GenerateAllLegalMoves();
+                if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+                    break;
+                }
+                pv.push_back(move);
+                current.makeMove(move);
+                if (current.isGameOver() != 'n' || !visited.insert(positionKey(current)).second) {
+                    break;
+                }
+                const HashEntry *entry = GetTranspositionEntry(current);
+                move = "";
+                if (entry != nullptr && entry->move != 0) {
+                    move = decodeTableMove(current.getBoard(), current.getToPlay(), entry->move);
+                }
+            }
+            return pv;
+        }
+
+        /*
+         * Iterative deepening over the transposition table search that reports the best multiPV root moves
+         * at each depth. The k-th line is searched with a full window and the k - 1 better moves excluded at
+         * the root, so its score is exact, and all lines share one table.
+         */
+        std::map<int, std::vector<PVLine>>
+        iterativeDeepeningMultiPV(const std::string &fen, int maxDepth, int multiPV, double timeLimitSeconds) {
+            return iterativeDeepeningMultiPV(Board(fen), maxDepth, multiPV, timeLimitSeconds);
+        }
+
+        std::map<int, std::vector<PVLine>>
+        iterativeDeepeningMultiPV(const Board &position, int maxDepth, int multiPV, double timeLimitSeconds) {
+            ProfilerBinding binding(profiler);
+            startTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
+            nodeCount = 0;
+            aborted = false;
+            auto timeLimit = seconds_to_duration(timeLimitSeconds);
+            Board board = rootBoard(position);
+            DepthMultiPV.clear();
+
+            unsigned long long previousNodes = 0;
+            for (int i = 1; i <= maxDepth; ++i) {
+                std::vector<PVLine> lines;
+                excludedRootMoves.clear();
+                SearchStats before = statsSnapshot();
+                auto start = std::chrono::steady_clock::now();
+                for (int k = 0; k < multiPV; ++k) {
+                    bestMove = "";
+                    int score = itAlphaBetaNegamaxWithTT(board, i, i, negINF, INF, timeLimit);
+                    LastCompletedDepth = aborted ? i - 1 : i;
+                    if (LastCompletedDepth != i || bestMove.empty()) {
+                        break;
+                    }
+                    lines.push_back({score, getPrincipalVariation(board, bestMove, i)});
+                    excludedRootMoves.insert(bestMove);
+                }
+                excludedRootMoves.clear();
+
+                if (LastCompletedDepth != i || lines.empty()) {
+                    break;
+                }
+                DepthMultiPV[i] = lines;
+                DepthMoves[i] = std::make_pair(lines.front().score, lines.front().pv.front());
+                bestMove = lines.front().pv.front();
+                std::chrono::duration<double> timeTaken = std::chrono::steady_clock::now() - start;
+                SearchStats iteration = statsSnapshot() - before;
+                reportStats("iterativeDeepeningMultiPV", i, timeTaken.count(), lines.front().score, iteration,
+                            previousNodes);
+                if (infoCallback) {
+                    std::chrono::duration<double> elapsed = std::chrono::duration<double>(
+                            std::chrono::system_clock::now().time_since_epoch()) - startTime;
+                    infoCallback(i, lines.front(), nodeCount, elapsed.count());
+                }
+                previousNodes = iteration.nodes;
+            }
+            return DepthMultiPV;
+        }
+
+        //Empties the transposition table, zeroing it across threads
+        void clearTranspositionTable(int threads = 1) {
+            TranspositionTable.clear(threads);
+        }
+
+        //Reallocates the transposition table with the given size in MB, dropping its entries
+        void setHashSize(size_t megabytes, int threads = 1) {
+            TranspositionTable.resize(megabytes, threads);
+        }
+
+        int hashfull() const {
+            return TranspositionTable.hashfull();
+        }
+    };
+
+    /*
+     * Game database file: a GameDatabaseHeader, one GameRecord per game, the moves of all games as 16 bit
+     * encodeMoveChain codes (each game's a contiguous run), then a PositionEntry for every position of every game
+     * sorted by position key. The file is read through a read only mapping.
+     */
+    struct GameDatabaseHeader {
+        char magic[4];
+        unsigned int version;
+        unsigned long long games;
+        unsigned long long moves;
+        unsigned long long positions;
+    };
+
+    struct GameRecord {
+        PackedPosition start;
+        unsigned int moveCount;
+        unsigned long long firstMove;
+        char result;
+        unsigned char reserved[7];
+    };
+
+    struct PositionEntry {
+        unsigned long long key;
+        unsigned int game;
+        unsigned short ply;
+        unsigned short reserved;
+    };
+
+    //Collects games in memory and writes them out as one database file
+    class GameDatabaseWriter {
+    public:
+        //Replays the moves from start to index every position; result is 'w', 'b', 'd' or 'n' if unknown
+        void addGame(const Board &start, const std::vector<std::string> &moves, char result) {
+            GameRecord record{};
+            record.start = start.pack();
+            record.moveCount = (unsigned int) moves.size();
+            record.firstMove = encodedMoves.size();
+            record.result = result;
+            auto game = (unsigned int) games.size();
+            Board board = start;
+            positions.push_back({keys.positionKey(board), game, 0, 0});
+            for (size_t i = 0; i < moves.size(); ++i) {
+                encodeMoveChain(moves[i], encodedMoves);
+                board.makeMove(moves[i]);
+                positions.push_back({keys.positionKey(board), game, (unsigned short) (i + 1), 0});
+            }
+            games.push_back(record);
+        }
+
+        size_t size() const {
+            return games.size();
+        }
+
+        bool write(const std::string &path) {
+            std::sort(positions.begin(), positions.end(), [](const PositionEntry &a, const PositionEntry &b) {
+                return a.key != b.key ? a.key < b.key : a.game != b.game ? a.game < b.game : a.ply < b.ply;
+            });
+            GameDatabaseHeader header{};
+            std::copy(GAMEDB_MAGIC, GAMEDB_MAGIC + 4, header.magic);
+            header.version = GAMEDB_VERSION;
+            header.games = games.size();
+            header.moves = encodedMoves.size();
+            header.positions = positions.size();
+            std::ofstream output(path, std::ios::binary);
+            output.write((const char *) &header, sizeof(header));
+            output.write((const char *) games.data(), (std::streamsize) (games.size() * sizeof(GameRecord)));
+            output.write((const char *) encodedMoves.data(),
+                         (std::streamsize) (encodedMoves.size() * sizeof(unsigned short)));
+            //Keeps the position index 8 byte aligned after an odd number of moves
+            std::vector<char> padding((8 - encodedMoves.size() * sizeof(unsigned short) % 8) % 8, 0);
+            output.write(padding.data(), (std::streamsize) padding.size());
+            output.write((const char *) positions.data(),
+                         (std::streamsize) (positions.size() * sizeof(PositionEntry)));
+            return (bool) output;
+        }
+
+    private:
+        MiniMax keys;
+        std::vector<GameRecord> games;
+        std::vector<unsigned short> encodedMoves;
+        std::vector<PositionEntry> positions;
+    };
+
+    class GameDatabase {
+    public:
+        GameDatabase() = default;
+
+        GameDatabase(const GameDatabase &) = delete;
+
+        GameDatabase &operator=(const GameDatabase &) = delete;
+
+        ~GameDatabase() {
+            close();
+        }
+
+        bool open(const std::string &path) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(GameDatabaseHeader)) {
+                ::close(fd);
+                return false;
+            }
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                return false;
+            }
+
+            auto header = (const GameDatabaseHeader *) data;
+            size_t movesSize = header->moves * sizeof(unsigned short);
+            movesSize += (8 - movesSize % 8) % 8;
+            size_t expected = sizeof(GameDatabaseHeader) + header->games * sizeof(GameRecord) + movesSize +
+                              header->positions * sizeof(PositionEntry);
+            if (std::string(header->magic, 4) != GAMEDB_MAGIC || header->version != GAMEDB_VERSION ||
+                expected > (size_t) st.st_size) {
+                munmap(data, st.st_size);
+                return false;
+            }
+
+            mapping = data;
+            mappingSize = st.st_size;
+            games = (const GameRecord *) ((const char *) data + sizeof(GameDatabaseHeader));
+            moves = (const unsigned short *) (games + header->games);
+            positions = (const PositionEntry *) ((const char *) moves + movesSize);
+            gameCount = header->games;
+            positionCount = header->positions;
+            return true;
+        }
+
+        void close() {
+            if (mapping != nullptr) {
+                munmap(mapping, mappingSize);
+            }
+            mapping = nullptr;
+            mappingSize = 0;
+            games = nullptr;
+            moves = nullptr;
+            positions = nullptr;
+            gameCount = 0;
+            positionCount = 0;
+        }
+
+        bool isOpen() const {
+            return mapping != nullptr;
+        }
+
+        size_t size() const {
+            return gameCount;
+        }
+
+        size_t positionsSize() const {
+            return positionCount;
+        }
+
+        const GameRecord &game(size_t index) const {
+            return games[index];
+        }
+
+        std::vector<std::string> getMoves(size_t index) const {
+            std::vector<std::string> list;
+            const unsigned short *codes = moves + games[index].firstMove;
+            for (unsigned int i = 0; i < games[index].moveCount; ++i) {
+                list.push_back(decodeMoveChain(codes));
+            }
+            return list;
+        }
+
+        //Calls visit(board, ply) for every position of the game in order, stopping early when it returns false
+        template<typename F>
+        void replay(size_t index, F visit) const {
+            Board board(games[index].start);
+            const unsigned short *codes = moves + games[index].firstMove;
+            if (!visit(board, 0)) {
+                return;
+            }
+            for (unsigned int i = 0; i < games[index].moveCount; ++i) {
+                board.makeMove(decodeMoveChain(codes));
+                if (!visit(board, (int) i + 1)) {
+                    return;
+                }
+            }
+        }
+
+        Board getPosition(size_t index, int ply) const {
+            Board position(games[index].start);
+            replay(index, [&](const Board &board, int p) {
+                position = board;
+                return p < ply;
+            });
+            return position;
+        }
+
+        //(game, ply) of every occurrence of the position key
+        std::vector<std::pair<size_t, int>> find(unsigned long long key) const {
+            std::vector<std::pair<size_t, int>> found;
+            auto first = std::lower_bound(positions, positions + positionCount, key,
+                                          [](const PositionEntry &e, unsigned long long k) { return e.key < k; });
+            for (auto it = first; it != positions + positionCount && it->key == key; ++it) {
+                found.emplace_back(it->game, it->ply);
+            }
+            return found;
+        }
+
+    private:
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+        const GameRecord *games = nullptr;
+        const unsigned short *moves = nullptr;
+        const PositionEntry *positions = nullptr;
+        size_t gameCount = 0;
+        size_t positionCount = 0;
+    };
+
+
+    //What Engine::search may spend: iterative searches stop at depth, nodes (0 for no limit) or seconds
+    struct SearchLimits {
+        int depth = 50;
+        unsigned long long nodes = 0;
+        double seconds = 1e9;
+        int mode = TRANSPOSITION_TABLES;
+        bool iterative = true;
+    };
+
+    /*
+     * A game in progress: the current board, the keys of the positions since the last capture or pawn move
+     * and a MiniMax whose table is kept from move to move. Moves are made on the board in place and searches
+     * start from it directly, so nothing goes through FEN between moves.
+     */
+    class Engine {
+    public:
+        explicit Engine(const std::string &fen = START_FEN) : board(fen) {}
+
+        //Starts a new game from fen and empties the transposition table
+        void newGame(const std::string &fen, int threads = 1) {
+            setPosition(fen);
+            minimax.clearTranspositionTable(threads);
+        }
+
+        //Continues from fen without history, keeping the table
+        void setPosition(const std::string &fen) {
+            board = Board(fen);
+            history.clear();
+        }
+
+        void applyMove(const std::string &move) {
+            unsigned long long key = minimax.positionKey(board);
+            board.makeMove(move);
+            if (board.getReversibleMoves() == 0) {
+                history.clear();
+            } else {
+                history.push_back(key);
+            }
+        }
+
+        //Best move for the side to move within limits, empty when there is none
+        std::string search(const SearchLimits &limits) {
+            minimax.setGameHistory(history);
+            if (!limits.iterative) {
+                return minimax.getBestMoveNegamax(board, limits.depth, limits.mode);
+            }
+            minimax.setNodeLimit(limits.nodes);
+            return minimax.iterativeDeepening(board, limits.depth, limits.mode, limits.seconds);
+        }
+
+        //The multiPV best lines at each completed depth of a transposition table search within limits
+        std::map<int, std::vector<PVLine>> analyse(const SearchLimits &limits, int multiPV) {
+            minimax.setGameHistory(history);
+            minimax.setNodeLimit(limits.nodes);
+            return minimax.iterativeDeepeningMultiPV(board, limits.depth, multiPV, limits.seconds);
+        }
+
+        //'w' or 'b' for a captured lion, 'd' for a draw (including a third repetition), otherwise 'n'
+        char isGameOver() {
+            char winner = board.isGameOver();
+            if (winner == 'n' && std::count(history.begin(), history.end(), minimax.positionKey(board)) >= 2) {
+                winner = 'd';
+            }
+            return winner;
+        }
+
+        const Board &getBoard() const {
+            return board;
+        }
+
+        //Score of the last search for the side that was to move
+        int getLastScore() const {
+            return minimax.getLastScore();
+        }
+
+        //The search itself, for options such as the book, tablebases, network or hash size
+        MiniMax &getMiniMax() {
+            return minimax;
+        }
+
+    private:
+        Board board;
+        std::vector<unsigned long long> history;
+        MiniMax minimax;
+    };
+
+
+    Board
+    playBoardNegamaxGame(std::string fen, int depth, int mode, char toPlayAs, int oppMode, int oppDepth = 2,
+                         bool ID = false, bool oppID = false,
+                         int myTime = 10, int oppTime = 10, const OpeningBook *book = nullptr,
+                         const Tablebases *tablebases = nullptr) {
+        int moveCount = 0;
+        Engine me(fen), opponent(fen);
+        for (Engine *engine: {&me, &opponent}) {
+            engine->getMiniMax().setOpeningBook(book);
+            engine->getMiniMax().setTablebases(tablebases);
+        }
+        SearchLimits myLimits, oppLimits;
+        myLimits.mode = mode;
+        myLimits.iterative = ID;
+        myLimits.depth = ID ? 50 : depth;
+        myLimits.seconds = myTime;
+        oppLimits.mode = oppMode;
+        oppLimits.iterative = ID;
+        oppLimits.depth = ID ? 50 : oppDepth;
+        oppLimits.seconds = oppTime;
+
+        char gameOver = me.isGameOver();
+        std::cout << fen << std::endl;
+        int moveIndex = 0;
+        while (gameOver == 'n') {
+            const Board &board = me.getBoard();
+            std::string move;
+            if (board.getToPlay() == toPlayAs) {
+                move = me.search(myLimits);
+            } else {
+                if (oppMode == ORDERED) {
+                    auto x = board.GenerateAllLegalMoves();
+                    if (moveIndex >= x.size()) {
+                        moveIndex = 0;
+                    }
+                    move = x[moveIndex];
+                    moveIndex++;
+                } else if (oppMode == RANDOM) {
+                    auto x = board.GenerateAllLegalMoves();
+                    move = getRandomMove(x);
+                } else {
+                    move = opponent.search(oppLimits);
+                }
+            }
+            if (board.getToPlay() == 'b') {
+                moveCount++;
+            }
+            me.applyMove(move);
+            opponent.applyMove(move);
+            std::cout << move << " -> " << me.getBoard().getFen() << std::endl;
+            gameOver = me.isGameOver();
+            if (moveCount == 100) {
+                gameOver = 'd';
+            }
+        }
+        std::cout << "Winner is: " << gameOver << std::endl;
+        return me.getBoard();
+    }
+
+    /*
+     * Expands the opening tree from fen for the given number of plies. Every node gets a full
+     * width search of depth searchDepth on each of its moves; moves within margin of the best
+     * become book moves (at most maxWidth of them) and their children are expanded on the next ply.
+     * Nodes of one ply are shared between the threads, each with its own MiniMax.
+     */
+    void buildOpeningBook(const std::string &fen, int plies, int searchDepth, int threads, int margin, int maxWidth,
+                          const std::string &path) {
+        std::vector<std::string> frontier = {fen};
+        std::set<unsigned long long int> seen;
+        std::vector<BookEntry> entries;
+        std::mutex lock;
+        MiniMax keyMinimax;
+        seen.insert(keyMinimax.positionKey(Board(fen)));
+
+        for (int ply = 0; ply < plies && !frontier.empty(); ++ply) {
+            std::vector<std::string> nextFrontier;
+            std::atomic<size_t> nextNode(0);
+            SearchStats plyStats;
+            auto plyStart = std::chrono::steady_clock::now();
+
+            auto worker = [&]() {
+                MiniMax mm;
+                for (size_t n = nextNode++; n < frontier.size(); n = nextNode++) {
+                    Board board(frontier[n]);
+                    if (board.isGameOver() != 'n') {
+                        continue;
+                    }
+                    std::vector<std::pair<int, std::string>> scored;
+                    for (const auto &m: board.GenerateAllLegalMoves()) {
+                        Board child = board;
+                        child.makeMove(m);
+                        int score = -mm.AlphaBetaNegamaxWithTT(child, searchDepth - 1, searchDepth, mm.negINF, mm.INF);
+                        scored.emplace_back(score, m);
+                    }
+                    if (scored.empty()) {
+                        continue;
+                    }
+                    std::stable_sort(scored.begin(), scored.end(),
+                                     [](const std::pair<int, std::string> &a, const std::pair<int, std::string> &b) {
+                                         return a.first > b.first;
+                                     });
+
+                    unsigned long long int key = mm.positionKey(board);
+                    int best = scored.front().first;
+                    std::lock_guard<std::mutex> guard(lock);
+                    for (size_t i = 0; i < scored.size() && i < (size_t) maxWidth; ++i) {
+                        if (best - scored[i].first > margin) {
+                            break;
+                        }
+                        BookEntry entry{};
+                        entry.key = key;
+                        entry.move = encodeTableMove(board.getBoard(), board.getToPlay(), scored[i].second);
+                        if (entry.move == 0) {
+                            continue;
+                        }
+                        entry.weight = (unsigned short) (margin + 1 - (best - scored[i].first));
+                        entries.push_back(entry);
+
+                        Board child = board;
+                        child.makeMove(scored[i].second);
+                        if (seen.insert(mm.positionKey(child)).second) {
+                            nextFrontier.push_back(child.getFen());
+                        }
+                    }
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                plyStats += mm.stats;
+            };
+
+            std::vector<std::thread> pool;
+            for (int t = 1; t < threads; ++t) {
+                pool.emplace_back(worker);
+            }
+            worker();
+            for (auto &t: pool) {
+                t.join();
+            }
+
+            std::cout << "Ply " << ply + 1 << ": " << frontier.size() << " positions, " << entries.size()
+                      << " book moves" << std::endl;
+            std::chrono::duration<double> plyTime = std::chrono::steady_clock::now() - plyStart;
+            std::cout << plyStats.toJson("buildOpeningBook", searchDepth, plyTime.count(), "", 0, 0) << std::endl;
+            frontier = nextFrontier;
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b) {
+            if (a.key != b.key) {
+                return a.key < b.key;
+            }
+            return a.weight > b.weight;
+        });
+
+        BookHeader header{};
+        std::copy(BOOK_MAGIC, BOOK_MAGIC + 4, header.magic);
+        header.version = BOOK_VERSION;
+        header.count = entries.size();
+        std::ofstream output(path, std::ios::binary);
+        output.write((const char *) &header, sizeof(header));
+        output.write((const char *) entries.data(), (std::streamsize) (entries.size() * sizeof(BookEntry)));
+        output.close();
+    }
+
+    /*
+     * Retrograde generation of one tablebase. Successors that leave the signature (captures, drownings)
+     * are looked up in the already generated smaller tables, the rest are stored as edges and resolved by
+     * repeated sweeps, one ply of distance each, until no position changes or waits for a longer win.
+     * Sweeps read the previous values and write a copy, so the result does not depend on the thread count.
+     * Positions that never resolve are draws.
+     */
+    std::vector<unsigned char>
+    generateTablebase(const std::string &signature, std::map<std::string, std::vector<unsigned char>> &generated,
+                      int threads) {
+        std::string extras = getSignatureExtras(signature);
+        for (size_t i = 0; i < extras.size(); ++i) {
+            std::string sub = signature;
+            sub.erase(sub.find(extras[i]), 1);
+            if (generated.find(sub) == generated.end()) {
+                generated[sub] = generateTablebase(sub, generated, threads);
+            }
+        }
+
+        auto size = (size_t) getTablebaseSize(signature);
+        const size_t chunk = 4096;
+        size_t chunks = (size + chunk - 1) / chunk;
+        //Positive: win in n plies, negative: loss in -value - 1 plies, 0: unresolved
+        std::vector<short> values(size, 0);
+        //1 for positions to resolve, 2 for positions drawn by rule
+        std::vector<unsigned char> valid(size, 0);
+        //Best result reachable through successors in other tables, for the side to move
+        std::vector<short> externalWin(size, 0);
+        std::vector<short> externalMaxLoss(size, 0);
+        std::vector<unsigned char> externalDraw(size, 0);
+        std::vector<unsigned char> edgeCount(size, 0);
+        std::vector<std::vector<unsigned int>> chunkEdges(chunks);
+
+        parallelFor(size, chunk, threads, [&](size_t begin, size_t end) {
+            auto &edges = chunkEdges[begin / chunk];
+            for (size_t i = begin; i < end; ++i) {
+                std::array<char, 49> b{};
+                char toPlay;
+                if (!getTablebasePosition((long long) i, signature, b, toPlay)) {
+                    continue;
+                }
+                valid[i] = 1;
+                Board board(b, toPlay, 0);
+                if (board.isGameOver() == 'd') {
+                    valid[i] = 2;
+                    continue;
+                }
+                auto moves = board.GenerateAllLegalMoves();
+                if (moves.empty()) {
+                    values[i] = -1;
+                    continue;
+                }
+                for (const auto &m: moves) {
+                    Board child = board;
+                    child.makeMove(m);
+                    auto childBoard = child.getBoard();
+                    if (getSinglePiecePos(childBoard, 'L') < 0 || getSinglePiecePos(childBoard, 'l') < 0) {
+                        values[i] = 1;
+                        break;
+                    }
+                    std::string childSignature = getMaterialSignature(childBoard);
+                    long long index = getTablebaseIndex(childBoard, child.getToPlay(), childSignature);
+                    if (childSignature == signature) {
+                        edges.push_back((unsigned int) index);
+                        edgeCount[i]++;
+                        continue;
+                    }
+                    short childValue = decodeTablebaseValue(generated.at(childSignature)[index]);
+                    if (childValue < 0) {
+                        short win = (short) (-childValue);
+                        if (externalWin[i] == 0 || win < externalWin[i]) {
+                            externalWin[i] = win;
+                        }
+                    } else if (childValue > 0) {
+                        externalMaxLoss[i] = std::max(externalMaxLoss[i], childValue);
+                    } else {
+                        externalDraw[i] = 1;
+                    }
+                }
+            }
+        });
+
+        std::vector<size_t> edgeStart(size + 1, 0);
+        std::vector<unsigned int> edges;
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t offset = 0;
+            for (size_t i = c * chunk; i < std::min(size, (c + 1) * chunk); ++i) {
+                edgeStart[i] = edges.size() + offset;
+                offset += edgeCount[i];
+            }
+            edges.insert(edges.end(), chunkEdges[c].begin(), chunkEdges[c].end());
+            chunkEdges[c].clear();
+            chunkEdges[c].shrink_to_fit();
+        }
+        edgeStart[size] = edges.size();
+
+        //Sweep n only sets wins in n plies, so a short win through a child resolved late is not hidden by a longer
+        //one found first; losses are set once every successor is a resolved win, which is then final
+        std::vector<short> next = values;
+        bool changed = true;
+        bool pending = false;
+        int sweeps = 0;
+        while (changed || pending) {
+            std::atomic<bool> anyChange(false);
+            std::atomic<bool> anyPending(false);
+            const int ply = sweeps + 1;
+            parallelFor(size, chunk, threads, [&](size_t begin, size_t end) {
+                bool local = false;
+                bool localPending = false;
+                for (size_t i = begin; i < end; ++i) {
+                    if (valid[i] != 1 || values[i] != 0) {
+                        continue;
+                    }
+                    short bestWin = externalWin[i];
+                    short maxLoss = externalMaxLoss[i];
+                    bool allWins = !externalDraw[i];
+                    for (size_t e = edgeStart[i]; e < edgeStart[i + 1]; ++e) {
+                        short childValue = values[edges[e]];
+                        if (childValue < 0) {
+                            if (bestWin == 0 || -childValue < bestWin) {
+                                bestWin = (short) (-childValue);
+                            }
+                        } else if (childValue > 0) {
+                            maxLoss = std::max(maxLoss, childValue);
+                        } else {
+                            allWins = false;
+                        }
+                    }
+                    if (bestWin > ply) {
+                        localPending = true;
+                    } else if (bestWin != 0) {
+                        next[i] = bestWin;
+                        local = true;
+                    } else if (allWins) {
+                        next[i] = (short) (-maxLoss - 2);
+                        local = true;
+                    }
+                }
+                if (local) {
+                    anyChange = true;
+                }
+                if (localPending) {
+                    anyPending = true;
+                }
+            });
+            changed = anyChange;
+            pending = anyPending;
+            values = next;
+            sweeps++;
+        }
+
+        std::vector<unsigned char> result(size);
+        for (size_t i = 0; i < size; ++i) {
+            result[i] = encodeTablebaseValue(values[i]);
+        }
+        std::cout << signature << ": " << size << " positions, " << sweeps << " sweeps" << std::endl;
+        return result;
+    }
+
+    void writeTablebase(const std::string &path, const std::string &signature, const std::vector<unsigned char> &values) {
+        TablebaseHeader header{};
+        std::copy(TB_MAGIC, TB_MAGIC + 4, header.magic);
+        header.version = TB_VERSION;
+        std::copy(signature.begin(), signature.begin() + (long) std::min<size_t>(signature.size(), 15),
+                  header.signature);
+        header.positions = values.size();
+        header.blockSize = TB_BLOCK_SIZE;
+        header.blocks = (unsigned int) ((values.size() + TB_BLOCK_SIZE - 1) / TB_BLOCK_SIZE);
+
+        std::vector<unsigned long long> offsets;
+        std::vector<unsigned char> data;
+        for (size_t block = 0; block < header.blocks; ++block) {
+            offsets.push_back(data.size());
+            size_t end = std::min(values.size(), (block + 1) * TB_BLOCK_SIZE);
+            for (size_t i = block * TB_BLOCK_SIZE; i < end;) {
+                size_t run = 1;
+                while (i + run < end && run < 255 && values[i + run] == values[i]) {
+                    run++;
+                }
+                data.push_back((unsigned char) run);
+                data.push_back(values[i]);
+                i += run;
+            }
+        }
+        offsets.push_back(data.size());
+
+        std::ofstream output(path, std::ios::binary);
+        output.write((const char *) &header, sizeof(header));
+        output.write((const char *) offsets.data(), (std::streamsize) (offsets.size() * sizeof(unsigned long long)));
+        output.write((const char *) data.data(), (std::streamsize) data.size());
+        output.close();
+    }
+
+    //Generates the requested signatures and every smaller table they depend on into directory
+    void generateTablebases(const std::vector<std::string> &signatures, const std::string &directory, int threads) {
+        std::map<std::string, std::vector<unsigned char>> generated;
+        for (const auto &signature: signatures) {
+            if (generated.find(signature) == generated.end()) {
+                generated[signature] = generateTablebase(signature, generated, threads);
+            }
+        }
+        std::filesystem::create_directories(directory);
+        for (const auto &i: generated) {
+            writeTablebase(directory + "/" + i.first + ".cgtb", i.first, i.second);
+        }
+    }
+
+}
+
+
+using namespace Congo;
+
+void ID_Output(int time, int Mode, const std::string &filename, const std::string &fen) {
+    std::ofstream output(filename);
+    auto mm = MiniMax();
+    int maxDepth = 20;
+    auto Arr = mm.iterativeDeepeningOutput(Board(fen), maxDepth, Mode, time);
+    for (const auto &i: Arr) {
+        output << i;
+    }
+    output.close();
+}
+
+void MultiPV_Output(int time, int multiPV, const std::string &filename, const std::string &fen) {
+    std::ofstream output(filename);
+    auto mm = MiniMax();
+    int maxDepth = 20;
+    auto lines = mm.iterativeDeepeningMultiPV(fen, maxDepth, multiPV, time);
+    for (const auto &i: lines) {
+        for (size_t k = 0; k < i.second.size(); ++k) {
+            output << "Depth: " << i.first << " PV: " << k + 1 << " Score: " << i.second[k].score << " Line:";
+            for (const auto &m: i.second[k].pv) {
+                output << " " << m;
+            }
+            output << std::endl;
+        }
+    }
+    output.close();
+}
+
+struct BenchResult {
+    int position;
+    std::string mode;
+    int depth;
+    std::string move;
+    unsigned long long nodes;
+    double medianTime;
+    double nps;
+    std::array<PhaseCounters, PhaseCount> phases{};
+    unsigned long long allocations = 0;
+    unsigned long long allocatedBytes = 0;
+};
+
+std::vector<std::string> readFenFile(const std::string &path) {
+    std::vector<std::string> fens;
+    std::ifstream input(path);
+    std::string line;
+    while (getline(input, line)) {
+        if (!line.empty() && line[0] != '#') {
+            fens.push_back(line);
+        }
+    }
+    return fens;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+//Opens the file of a --trace option; the searches only record into it in builds with -DCONGO_TRACE
+bool openTrace(SearchTracer &tracer, const std::string &path, unsigned int sample) {
+#ifdef CONGO_TRACE
+    if (!tracer.open(path, sample)) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void) tracer;
+    (void) sample;
+    std::cerr << "Tracing to " << path << " needs a build with -DCONGO_TRACE" << std::endl;
+    return false;
+#endif
+}
+
+//Opens the counters of a --profile run; the phases are only charged in builds with -DCONGO_PERF or allocations
+bool openProfiler(PhaseProfiler &profiler) {
+#ifdef CONGO_PERF
+    if (!profiler.open()) {
+        std::cerr << "No hardware counters (perf_event_paranoid, or a virtual machine), timing phases only"
+                  << std::endl;
+    }
+    return true;
+#elif defined(CONGO_TRACK_ALLOCS)
+    (void) profiler;
+    return true;
+#else
+    (void) profiler;
+    std::cerr << "Profiling needs a build with -DCONGO_PERF or -DCONGO_TRACK_ALLOCS" << std::endl;
+    return false;
+#endif
+}
+
+//Runs one position in one mode runs times from a fresh, identically seeded engine
+//The phases and the allocations of the searches (not of the MiniMax) are those of the last run
+BenchResult runBench(int position, const std::string &fen, int Mode, const std::string &modeName, int depth, int runs,
+                     SearchTracer *tracer, PhaseProfiler *profiler) {
+    BenchResult result{position, modeName, depth, "", 0, 0, 0};
+    std::vector<double> times;
+    for (int r = 0; r < runs; ++r) {
+        seedRandom(BENCH_SEED);
+        MiniMax mm;
+        mm.setTracer(tracer);
+        if (profiler != nullptr) {
+            profiler->reset();
+        }
+        mm.setProfiler(profiler);
+        unsigned long long allocations = getAllocationCount();
+        unsigned long long bytes = getAllocatedBytes();
+        auto start = std::chrono::steady_clock::now();
+        if (Mode == ITERATIVE_DEEPENING) {
+            result.move = mm.iterativeDeepening(fen, depth, TRANSPOSITION_TABLES, 1000000);
+        } else {
+            result.move = mm.getBestMoveNegamax(fen, depth, Mode);
+        }
+        std::chrono::duration<double> timeTaken = std::chrono::steady_clock::now() - start;
+        result.allocations = getAllocationCount() - allocations;
+        result.allocatedBytes = getAllocatedBytes() - bytes;
+        times.push_back(timeTaken.count());
+        result.nodes = mm.stats.nodes;
+    }
+    if (profiler != nullptr) {
+        result.phases = profiler->getPhases();
+    }
+    result.medianTime = median(times);
+    result.nps = result.medianTime > 0 ? (double) result.nodes / result.medianTime : 0;
+    return result;
+}
+
+std::string benchJson(const BenchResult &r, int runs, const PhaseProfiler *profiler) {
+    std::ostringstream json;
+    json << "{\"position\":" << r.position << ",\"mode\":\"" << r.mode << "\",\"depth\":" << r.depth
+         << ",\"move\":\"" << r.move << "\",\"nodes\":" << r.nodes << ",\"runs\":" << runs
+         << ",\"median\":" << r.medianTime << ",\"nps\":" << (unsigned long long) r.nps;
+    if (allocationTracking()) {
+        json << ",\"allocations\":" << r.allocations << ",\"allocatedBytes\":" << r.allocatedBytes
+             << ",\"allocationsPerNode\":" << (r.nodes > 0 ? (double) r.allocations / (double) r.nodes : 0.0);
+    }
+    if (profiler != nullptr) {
+        json << ",\"phases\":" << phasesJson(r.phases, profiler->available());
+    }
+    json << "}";
+    return json.str();
+}
+
+/*
+ * Per phase totals of a profiled bench: time per call and share of the search time, and when the counters are
+ * there cycles per call, instructions per cycle and cache misses and branch mispredictions per thousand
+ * instructions. Low IPC with many cache misses points to a memory bound phase, many mispredictions to a branch
+ * bound one. Tracked allocations add allocations and bytes per call.
+ */
+void printPhaseTable(const std::vector<BenchResult> &results, double totalTime, const PhaseProfiler &profiler) {
+    std::array<PhaseCounters, PhaseCount> phases{};
+    for (const auto &r: results) {
+        for (int p = 0; p < PhaseCount; ++p) {
+            phases[p] += r.phases[p];
+        }
+    }
+    auto available = profiler.available();
+    bool counters = available[0] && available[1] && available[2] && available[3];
+    auto ratio = [](double a, double b) { return b == 0 ? 0.0 : a / b; };
+    std::cout << std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "calls" << std::setw(10)
+              << "ns/call" << std::setw(8) << "time%";
+    if (counters) {
+        std::cout << std::setw(12) << "cycles/call" << std::setw(7) << "IPC" << std::setw(12) << "cache-MPKI"
+                  << std::setw(13) << "branch-MPKI";
+    }
+    if (allocationTracking()) {
+        std::cout << std::setw(13) << "allocs/call" << std::setw(12) << "bytes/call";
+    }
+    std::cout << std::endl << std::fixed << std::setprecision(1);
+    for (int p = 0; p < PhaseCount; ++p) {
+        const PhaseCounters &c = phases[p];
+        double calls = (double) c.calls;
+        double instructions = (double) c.counters[1];
+        std::cout << std::left << std::setw(10) << SearchPhaseNames[p] << std::right << std::setw(12) << c.calls
+                  << std::setw(10) << ratio((double) c.nanoseconds, calls) << std::setw(8)
+                  << 100 * ratio((double) c.nanoseconds, totalTime * 1e9);
+        if (counters) {
+            std::cout << std::setw(12) << ratio((double) c.counters[0], calls) << std::setw(7) << std::setprecision(2)
+                      << ratio(instructions, (double) c.counters[0]) << std::setprecision(1) << std::setw(12)
+                      << 1000 * ratio((double) c.counters[2], instructions) << std::setw(13)
+                      << 1000 * ratio((double) c.counters[3], instructions);
+        }
+        if (allocationTracking()) {
+            std::cout << std::setw(13) << std::setprecision(2) << ratio((double) c.allocations, calls)
+                      << std::setw(12) << std::setprecision(1) << ratio((double) c.allocatedBytes, calls);
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+//Keeps the compiler from discarding a benchmarked result
+template<typename T>
+void doNotOptimize(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct MicroResult {
+    std::string name;
+    double nsPerOp;
+    double deviation;
+    double allocsPerOp;
+};
+
+/*
+ * Times op(i) over samples batches of batch calls after a warmup, where i walks the corpus. Reports the
+ * median batch in ns/op with the median absolute deviation, so a few descheduled batches do not move it.
+ * setup(i) runs untimed before each call's batch when an operation needs fresh input.
+ */
+template<typename Setup, typename Op>
+MicroResult microBenchmark(const std::string &name, size_t corpusSize, int samples, int batch, Setup setup, Op op) {
+    for (int i = 0; i < batch; ++i) {
+        setup(i, i % corpusSize);
+        op(i, i % corpusSize);
+    }
+    std::vector<double> times;
+    unsigned long long allocations = 0;
+    size_t next = 0;
+    for (int s = 0; s < samples; ++s) {
+        for (int i = 0; i < batch; ++i) {
+            setup(i, (next + i) % corpusSize);
+        }
+        unsigned long long allocationsBefore = getAllocationCount();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < batch; ++i) {
+            op(i, (next + i) % corpusSize);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        allocations += getAllocationCount() - allocationsBefore;
+        times.push_back(elapsed.count() / batch);
+        next += batch;
+    }
+    double mid = median(times);
+    std::vector<double> deviations;
+    for (auto t: times) {
+        deviations.push_back(std::abs(t - mid));
+    }
+    return {name, mid, median(deviations), (double) allocations / ((double) samples * batch)};
+}
+
+//Positions from seeded games of a shallow alpha beta engine against random moves
+std::vector<std::string> buildPositionCorpus(int games, unsigned int seed) {
+    std::vector<std::string> corpus;
+    std::mt19937 gen(seed);
+    MiniMax mm;
+    for (int game = 0; game < games; ++game) {
+        Board board("2ele1z/ppppppp/7/7/7/PPPPPPP/2ELE1Z w 0");
+        for (int ply = 0; ply < 80 && board.isGameOver() == 'n'; ++ply) {
+            auto moves = board.GenerateAllLegalMoves();
+            if (moves.empty()) {
+                break;
+            }
+            corpus.push_back(board.getFen());
+            std::string move = ply % 2 ? *select_randomly(moves.begin(), moves.end(), gen)
+                                       : mm.getBestMoveNegamax(board.getFen(), 1, ALPHA_BETA);
+            board.makeMove(move);
+        }
+    }
+    return corpus;
+}
+
+//congo microbench [--samples n] [--batch n] [--games n]
+int microbench(const std::vector<std::string> &args) {
+    int samples = 31;
+    int batch = 1000;
+    int games = 20;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--samples") samples = std::stoi(args[i + 1]);
+        else if (args[i] == "--batch") batch = std::stoi(args[i + 1]);
+        else if (args[i] == "--games") games = std::stoi(args[i + 1]);
+    }
+
+    auto fens = buildPositionCorpus(games, BENCH_SEED);
+    std::vector<Board> boards;
+    std::vector<std::array<char, 49>> arrays;
+    std::vector<char> toPlay;
+    std::vector<std::string> moves;
+    std::mt19937 gen(BENCH_SEED);
+    for (const auto &fen: fens) {
+        boards.emplace_back(fen);
+        arrays.push_back(boards.back().getBoard());
+        toPlay.push_back(boards.back().getToPlay());
+        auto legal = boards.back().GenerateAllLegalMoves();
+        moves.push_back(*select_randomly(legal.begin(), legal.end(), gen));
+    }
+    size_t n = fens.size();
+    MiniMax mm;
+    std::vector<Board> scratch(batch, boards.front());
+    auto none = [](int, size_t) {};
+
+    std::vector<MicroResult> results;
+    results.push_back(microBenchmark("LionMoves", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(LionMoves(arrays[i], toPlay[i]));
+    }));
+    results.push_back(microBenchmark("ZebraMoves", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(ZebraMoves(arrays[i], toPlay[i]));
+    }));
+    results.push_back(microBenchmark("ElephantMoves", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(ElephantMoves(arrays[i], toPlay[i]));
+    }));
+    results.push_back(microBenchmark("PawnMoves", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(PawnMoves(arrays[i], toPlay[i]));
+    }));
+    results.push_back(microBenchmark("GenerateAllLegalMoves", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(boards[i].GenerateAllLegalMoves());
+    }));
+    results.push_back(microBenchmark("Board::makeMove", n, samples, batch, [&](int slot, size_t i) {
+        scratch[slot] = boards[i];
+    }, [&](int slot, size_t i) {
+        scratch[slot].makeMove(moves[i]);
+        doNotOptimize(scratch[slot]);
+    }));
+    results.push_back(microBenchmark("Board copy", n, samples, batch, none, [&](int, size_t i) {
+        Board copy = boards[i];
+        doNotOptimize(copy);
+    }));
+    results.push_back(microBenchmark("BasicBoardEvaluation", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(mm.BasicBoardEvaluation(boards[i]));
+    }));
+    results.push_back(microBenchmark("boardEvaluation", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(mm.boardEvaluation(boards[i]));
+    }));
+    results.push_back(microBenchmark("computeHash", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(mm.computeHash(arrays[i]));
+    }));
+    results.push_back(microBenchmark("getFen", n, samples, batch, none, [&](int, size_t i) {
+        doNotOptimize(boards[i].getFen());
+    }));
+    results.push_back(microBenchmark("Board(fen)", n, samples, batch, none, [&](int, size_t i) {
+        Board board(fens[i]);
+        doNotOptimize(board);
+    }));
+
+    std::cout << n << " positions, " << samples << " samples of " << batch << " ops" << std::endl;
+    std::cout << std::left << std::setw(24) << "benchmark" << std::right << std::setw(12) << "ns/op"
+              << std::setw(10) << "+/-" << std::setw(14) << "allocs/op" << std::endl;
+    for (const auto &r: results) {
+        std::cout << std::left << std::setw(24) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.nsPerOp << std::setw(10) << r.deviation << std::setw(14);
+        if (allocationTracking()) {
+            std::cout << r.allocsPerOp;
+        } else {
+            std::cout << "n/a";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+/*
+ * congo bench [--runs n] [--positions file] [--csv file] [--json file] [--baseline file] [--threshold percent]
+ *             [--trace file] [--trace-sample n] [--profile] [--forbid-allocs]
+ *
+ * Searches every position in every mode at a fixed depth and reports the median time, nodes and NPS.
+ * With a baseline (a JSON file from an earlier run) it fails when a median is slower than the baseline by
+ * more than threshold percent. Node counts are deterministic, so a change there means the search changed.
+ */
+int bench(const std::vector<std::string> &args) {
+    int runs = 3;
+    double threshold = 10;
+    std::string positionsFile = "bench_positions.txt";
+    std::string csvFile = "bench.csv";
+    std::string jsonFile = "bench.json";
+    std::string baselineFile, tracePath;
+    unsigned int traceSample = 1;
+    bool profile = false;
+    bool forbidAllocations = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--profile") profile = true;
+        else if (args[i] == "--forbid-allocs") forbidAllocations = true;
+        else if (i + 1 >= args.size()) break;
+        else if (args[i] == "--runs") runs = std::stoi(args[++i]);
+        else if (args[i] == "--positions") positionsFile = args[++i];
+        else if (args[i] == "--csv") csvFile = args[++i];
+        else if (args[i] == "--json") jsonFile = args[++i];
+        else if (args[i] == "--baseline") baselineFile = args[++i];
+        else if (args[i] == "--threshold") threshold = std::stod(args[++i]);
+        else if (args[i] == "--trace") tracePath = args[++i];
+        else if (args[i] == "--trace-sample") traceSample = std::stoul(args[++i]);
+    }
+    SearchTracer tracer;
+    if (!tracePath.empty() && !openTrace(tracer, tracePath, traceSample)) {
+        return 1;
+    }
+    PhaseProfiler profiler;
+    if (profile && !openProfiler(profiler)) {
+        return 1;
+    }
+    if (forbidAllocations && !allocationTracking()) {
+        std::cerr << "--forbid-allocs needs a build with -DCONGO_TRACK_ALLOCS" << std::endl;
+        return 1;
+    }
+
+    auto fens = readFenFile(positionsFile);
+    if (fens.empty()) {
+        std::cerr << "No positions in " << positionsFile << std::endl;
+        return 1;
+    }
+    std::vector<std::tuple<int, std::string, int>> modes = {{STANDARD,            "STD", 3},
+                                                           {ALPHA_BETA,          "AB",  4},
+                                                           {TRANSPOSITION_TABLES, "TT",  4},
+                                                           {ITERATIVE_DEEPENING, "ID",  4}};
+
+    std::vector<BenchResult> results;
+    std::ofstream csv(csvFile);
+    std::ofstream json(jsonFile);
+    csv << "position,mode,depth,move,nodes,runs,median,nps" << std::endl;
+    for (size_t p = 0; p < fens.size(); ++p) {
+        for (const auto &mode: modes) {
+            auto r = runBench(p, fens[p], std::get<0>(mode), std::get<1>(mode), std::get<2>(mode), runs,
+                              tracePath.empty() ? nullptr : &tracer, profile ? &profiler : nullptr);
+            results.push_back(r);
+            csv << r.position << "," << r.mode << "," << r.depth << "," << r.move << "," << r.nodes << "," << runs
+                << "," << r.medianTime << "," << (unsigned long long) r.nps << std::endl;
+            json << benchJson(r, runs, profile ? &profiler : nullptr) << std::endl;
+            std::cout << benchJson(r, runs, profile ? &profiler : nullptr) << std::endl;
+        }
+    }
+
+    unsigned long long totalNodes = 0, totalAllocations = 0, totalBytes = 0;
+    double totalTime = 0;
+    for (const auto &r: results) {
+        totalNodes += r.nodes;
+        totalTime += r.medianTime;
+        totalAllocations += r.allocations;
+        totalBytes += r.allocatedBytes;
+    }
+    std::cout << "Total nodes: " << totalNodes << " Total time: " << totalTime << " NPS: "
+              << (unsigned long long) (totalNodes / totalTime) << std::endl;
+    if (allocationTracking()) {
+        std::cout << "Allocations: " << totalAllocations << " (" << totalBytes << " bytes, "
+                  << (totalNodes > 0 ? (double) totalAllocations / (double) totalNodes : 0.0) << " per node)"
+                  << std::endl;
+    }
+    if (profile) {
+        printPhaseTable(results, totalTime, profiler);
+    }
+
+    //Earlier runs warm up the lazily built tables, so the last run's allocations are per node work. Moves are
+    //strings in vectors built per node, so every search allocates and --forbid-allocs, a target, always fails
+    int allocating = 0;
+    for (const auto &r: results) {
+        if (forbidAllocations && r.allocations > 0) {
+            std::cout << "Position " << r.position << " " << r.mode << ": " << r.allocations << " allocations"
+                      << std::endl;
+            allocating++;
+        }
+    }
+    if (forbidAllocations) {
+        std::cout << allocating << " searches allocated" << std::endl;
+    }
+
+    if (baselineFile.empty()) {
+        return allocating > 0 ? 1 : 0;
+    }
+    std::ifstream baseline(baselineFile);
+    if (!baseline) {
+        std::cerr << "Missing baseline " << baselineFile << std::endl;
+        return 1;
+    }
+    std::map<std::pair<int, std::string>, std::pair<double, unsigned long long>> base;
+    std::string line;
+    while (getline(baseline, line)) {
+        if (line.find("\"position\"") != std::string::npos) {
+            base[{(int) jsonNumber(line, "position"), jsonString(line, "mode")}] = {
+                    jsonNumber(line, "median"), (unsigned long long) jsonNumber(line, "nodes")};
+        }
+    }
+
+    //Searches shorter than this are reported but too noisy to fail on
+    const double minimumTime = 0.01;
+    int regressions = 0;
+    double baseTotal = 0, currentTotal = 0;
+    for (const auto &r: results) {
+        auto it = base.find({r.position, r.mode});
+        if (it == base.end()) {
+            continue;
+        }
+        baseTotal += it->second.first;
+        currentTotal += r.medianTime;
+        double change = it->second.first > 0 ? (r.medianTime / it->second.first - 1) * 100 : 0;
+        bool slower = change > threshold && it->second.first >= minimumTime;
+        regressions += slower ? 1 : 0;
+        std::cout << "Position " << r.position << " " << r.mode << ": " << (change >= 0 ? "+" : "") << change
+                  << "% time" << (slower ? " REGRESSION" : "");
+        if (r.nodes != it->second.second) {
+            std::cout << " nodes " << it->second.second << " -> " << r.nodes;
+        }
+        std::cout << std::endl;
+    }
+    double totalChange = baseTotal > 0 ? (currentTotal / baseTotal - 1) * 100 : 0;
+    if (totalChange > threshold) {
+        regressions++;
+    }
+    std::cout << "Total: " << (totalChange >= 0 ? "+" : "") << totalChange << "% time" << std::endl;
+    std::cout << regressions << " regressions over " << threshold << "%" << std::endl;
+    return regressions > 0 || allocating > 0 ? 1 : 0;
+}
+
+/*
+ * An engine setup for tournaments: "STD:2", "AB:4", "TT:5" search to a fixed depth, "ID-AB:50:1" and
+ * "ID-TT:50:1" iterate up to a depth within a time limit in seconds, "RANDOM" plays random moves.
+ */
+struct EngineConfig {
+    std::string name;
+    int mode = ALPHA_BETA;
+    int depth = 4;
+    bool ID = false;
+    int time = 10;
+};
+
+EngineConfig parseEngineConfig(const std::string &spec) {
+    EngineConfig config;
+    config.name = spec;
+    std::vector<std::string> parts;
+    std::stringstream stream(spec);
+    std::string part;
+    while (getline(stream, part, ':')) {
+        parts.push_back(part);
+    }
+    std::string mode = parts[0];
+    if (mode.rfind("ID-", 0) == 0) {
+        config.ID = true;
+        mode = mode.substr(3);
+    }
+    if (mode == "STD") config.mode = STANDARD;
+    else if (mode == "AB") config.mode = ALPHA_BETA;
+    else if (mode == "TT") config.mode = TRANSPOSITION_TABLES;
+    else if (mode == "RANDOM") config.mode = RANDOM;
+    else throw std::invalid_argument("Unknown engine " + spec);
+    if (parts.size() > 1) config.depth = std::stoi(parts[1]);
+    if (parts.size() > 2) config.time = std::stoi(parts[2]);
+    return config;
+}
+
+struct MatchSettings {
+    int maxMoves = 100;
+    int adjudicateScore = 1000;
+    int adjudicateMoves = 4;
+    const Tablebases *tablebases = nullptr;
+};
+
+/*
+ * Plays one quiet game and returns 'w', 'b' or 'd'. A game is adjudicated once both engines have agreed
+ * for adjudicateMoves moves each that one side is ahead by adjudicateScore, or as soon as the position is
+ * in the tablebases.
+ */
+char playMatchGame(const std::string &fen, const EngineConfig &white, const EngineConfig &black,
+                   const MatchSettings &settings, std::mt19937 &gen) {
+    Engine whiteEngine(fen), blackEngine(fen);
+    whiteEngine.getMiniMax().setTablebases(settings.tablebases);
+    blackEngine.getMiniMax().setTablebases(settings.tablebases);
+    int whiteAhead = 0, blackAhead = 0;
+    for (int ply = 0; ply < settings.maxMoves * 2; ++ply) {
+        const Board &board = whiteEngine.getBoard();
+        char gameOver = whiteEngine.isGameOver();
+        if (gameOver != 'n') {
+            return gameOver;
+        }
+        int tbScore;
+        if (settings.tablebases != nullptr &&
+            settings.tablebases->probe(board.getBoard(), board.getToPlay(), tbScore)) {
+            if (tbScore == 0) {
+                return 'd';
+            }
+            return tbScore > 0 ? board.getToPlay() : flipColour(board.getToPlay());
+        }
+
+        bool whiteToPlay = board.getToPlay() == 'w';
+        const EngineConfig &config = whiteToPlay ? white : black;
+        Engine &engine = whiteToPlay ? whiteEngine : blackEngine;
+        std::string move;
+        if (config.mode == RANDOM) {
+            auto moves = board.GenerateAllLegalMoves();
+            if (moves.empty()) {
+                return flipColour(board.getToPlay());
+            }
+            move = *select_randomly(moves.begin(), moves.end(), gen);
+        } else {
+            SearchLimits limits;
+            limits.depth = config.depth;
+            limits.mode = config.mode;
+            limits.iterative = config.ID;
+            limits.seconds = config.time;
+            move = engine.search(limits);
+            if (move.empty()) {
+                return flipColour(board.getToPlay());
+            }
+            int whiteScore = whiteToPlay ? engine.getLastScore() : -engine.getLastScore();
+            whiteAhead = whiteScore >= settings.adjudicateScore ? whiteAhead + 1 : 0;
+            blackAhead = whiteScore <= -settings.adjudicateScore ? blackAhead + 1 : 0;
+            if (whiteAhead >= settings.adjudicateMoves * 2) {
+                return 'w';
+            }
+            if (blackAhead >= settings.adjudicateMoves * 2) {
+                return 'b';
+            }
+        }
+        whiteEngine.applyMove(move);
+        blackEngine.applyMove(move);
+    }
+    return 'd';
+}
+
+//Starting positions reached by random moves from fen, skipping lines that end the game
+std::vector<std::string> buildOpeningSuite(const std::string &fen, int count, int plies, unsigned int seed) {
+    std::vector<std::string> openings;
+    std::mt19937 gen(seed);
+    while (openings.size() < (size_t) count) {
+        Board board(fen);
+        for (int ply = 0; ply < plies && board.isGameOver() == 'n'; ++ply) {
+            auto moves = board.GenerateAllLegalMoves();
+            if (moves.empty()) {
+                break;
+            }
+            board.makeMove(*select_randomly(moves.begin(), moves.end(), gen));
+        }
+        if (board.isGameOver() == 'n') {
+            openings.push_back(board.getFen());
+        }
+    }
+    return openings;
+}
+
+double eloFromScore(double score) {
+    score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+}
+
+double scoreFromElo(double elo) {
+    return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+struct MatchResult {
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+
+    int games() const {
+        return wins + draws + losses;
+    }
+
+    double score() const {
+        return games() == 0 ? 0.5 : (wins + 0.5 * draws) / games();
+    }
+
+    //Per game variance of the score
+    double variance() const {
+        double s = score();
+        if (games() == 0) {
+            return 0;
+        }
+        return (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games();
+    }
+
+    //Log likelihood ratio of elo1 against elo0, normal approximation of the trinomial
+    double llr(double elo0, double elo1) const {
+        double var = variance();
+        if (games() == 0 || var <= 0) {
+            return 0;
+        }
+        double s0 = scoreFromElo(elo0);
+        double s1 = scoreFromElo(elo1);
+        return games() * (s1 - s0) * (2 * score() - s0 - s1) / (2 * var);
+    }
+};
+
+/*
+ * congo tournament [--engine1 spec] [--engine2 spec] [--games n] [--threads n] [--opening-plies n] [--seed n]
+ *                  [--elo0 e] [--elo1 e] [--alpha a] [--beta b] [--max-moves n] [--adjudicate-score cp]
+ *                  [--adjudicate-moves n] [--tablebases dir]
+ *
+ * Plays engine1 against engine2 from random openings, each opening twice with colours swapped, across
+ * all threads. Reports engine1's Elo with a 95% interval and stops early once the SPRT of elo1 against
+ * elo0 is decided.
+ */
+int tournament(const std::vector<std::string> &args) {
+    std::string engine1 = "TT:4", engine2 = "AB:4", tablebaseDir;
+    int games = 1000;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    int openingPlies = 4;
+    unsigned int seed = BENCH_SEED;
+    double elo0 = 0, elo1 = 10, alpha = 0.05, beta = 0.05;
+    MatchSettings settings;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--engine1") engine1 = args[i + 1];
+        else if (args[i] == "--engine2") engine2 = args[i + 1];
+        else if (args[i] == "--games") games = std::stoi(args[i + 1]);
+        else if (args[i] == "--threads") threads = std::stoi(args[i + 1]);
+        else if (args[i] == "--opening-plies") openingPlies = std::stoi(args[i + 1]);
+        else if (args[i] == "--seed") seed = std::stoul(args[i + 1]);
+        else if (args[i] == "--elo0") elo0 = std::stod(args[i + 1]);
+        else if (args[i] == "--elo1") elo1 = std::stod(args[i + 1]);
+        else if (args[i] == "--alpha") alpha = std::stod(args[i + 1]);
+        else if (args[i] == "--beta") beta = std::stod(args[i + 1]);
+        else if (args[i] == "--max-moves") settings.maxMoves = std::stoi(args[i + 1]);
+        else if (args[i] == "--adjudicate-score") settings.adjudicateScore = std::stoi(args[i + 1]);
+        else if (args[i] == "--adjudicate-moves") settings.adjudicateMoves = std::stoi(args[i + 1]);
+        else if (args[i] == "--tablebases") tablebaseDir = args[i + 1];
+    }
+    EngineConfig first = parseEngineConfig(engine1);
+    EngineConfig second = parseEngineConfig(engine2);
+    Tablebases tablebases;
+    if (!tablebaseDir.empty() && tablebases.load(tablebaseDir) > 0) {
+        settings.tablebases = &tablebases;
+    }
+
+    int pairs = (games + 1) / 2;
+    auto openings = buildOpeningSuite(START_FEN, pairs, openingPlies, seed);
+    double lower = std::log(beta / (1 - alpha));
+    double upper = std::log((1 - beta) / alpha);
+    MatchResult result;
+    std::mutex lock;
+    std::atomic<bool> decided(false);
+
+    parallelFor(pairs, 1, threads, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end && !decided; ++p) {
+            std::mt19937 gen(seed + (unsigned int) p);
+            char asWhite = playMatchGame(openings[p], first, second, settings, gen);
+            char asBlack = playMatchGame(openings[p], second, first, settings, gen);
+
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto outcome: {asWhite == 'w' ? 1 : asWhite == 'b' ? -1 : 0,
+                                asBlack == 'b' ? 1 : asBlack == 'w' ? -1 : 0}) {
+                result.wins += outcome == 1;
+                result.draws += outcome == 0;
+                result.losses += outcome == -1;
+            }
+            double llr = result.llr(elo0, elo1);
+            if (llr <= lower || llr >= upper) {
+                decided = true;
+            }
+            if (result.games() % 20 == 0 || decided) {
+                std::cout << "Games: " << result.games() << " +" << result.wins << " =" << result.draws << " -"
+                          << result.losses << " LLR: " << llr << " [" << lower << ", " << upper << "]" << std::endl;
+            }
+        }
+    });
+
+    double stderror = std::sqrt(result.variance() / std::max(1, result.games()));
+    double elo = eloFromScore(result.score());
+    double eloLow = eloFromScore(result.score() - 1.96 * stderror);
+    double eloHigh = eloFromScore(result.score() + 1.96 * stderror);
+    double llr = result.llr(elo0, elo1);
+    std::cout << first.name << " vs " << second.name << ": " << result.games() << " games +" << result.wins << " ="
+              << result.draws << " -" << result.losses << std::endl;
+    std::cout << "Score: " << result.score() << " Elo: " << elo << " +/- " << (eloHigh - eloLow) / 2
+              << " (95%: " << eloLow << " to " << eloHigh << ")" << std::endl;
+    std::cout << "SPRT elo0=" << elo0 << " elo1=" << elo1 << " LLR: " << llr << " [" << lower << ", " << upper
+              << "] " << (llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted" : "inconclusive") << std::endl;
+    return 0;
+}
+
+//One "fen;move;score;pv;nodes" line for a position, scored for the side to move
+std::string analysePosition(MiniMax &mm, const std::string &fen, int depth, int timeLimitSeconds) {
+    auto lines = mm.iterativeDeepeningMultiPV(fen, depth, 1, timeLimitSeconds);
+    std::stringstream result;
+    result << fen << ";";
+    if (lines.empty()) {
+        result << ";;";
+    } else {
+        const PVLine &line = lines.rbegin()->second.front();
+        result << line.pv.front() << ";" << line.score << ";";
+        for (size_t i = 0; i < line.pv.size(); ++i) {
+            result << (i == 0 ? "" : " ") << line.pv[i];
+        }
+    }
+    result << ";" << mm.getNodeCount();
+    return result.str();
+}
+
+/*
+ * congo analyse [--input file] [--output file] [--depth n] [--time seconds] [--nodes n] [--threads n]
+ *               [--window n] [--hash MB] [--nnue file] [--tablebases dir] [--trace file] [--trace-sample n]
+ *
+ * Reads FENs from the input (stdin by default), one per line with '#' comments, and searches each to the depth, time and node
+ * budget with the transposition table search on a pool of threads, each with its own MiniMax. Results are
+ * written in input order as "fen;move;score;pv;nodes"; workers wait when they get more than the window of
+ * positions ahead of the output, so memory stays bounded however long the input is.
+ */
+int analyse(const std::vector<std::string> &args) {
+    std::string inputPath = "-", outputPath = "-", tablebaseDir;
+    int depth = 8;
+    int timeLimit = 10;
+    unsigned long long nodes = 0;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    size_t window = 0;
+    size_t hashMB = TT_DEFAULT_MB;
+    std::string networkPath, tracePath;
+    unsigned int traceSample = 1;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--input") inputPath = args[i + 1];
+        else if (args[i] == "--output") outputPath = args[i + 1];
+        else if (args[i] == "--depth") depth = std::stoi(args[i + 1]);
+        else if (args[i] == "--time") timeLimit = std::stoi(args[i + 1]);
+        else if (args[i] == "--nodes") nodes = std::stoull(args[i + 1]);
+        else if (args[i] == "--threads") threads = std::stoi(args[i + 1]);
+        else if (args[i] == "--window") window = std::stoul(args[i + 1]);
+        else if (args[i] == "--hash") hashMB = std::stoul(args[i + 1]);
+        else if (args[i] == "--nnue") networkPath = args[i + 1];
+        else if (args[i] == "--tablebases") tablebaseDir = args[i + 1];
+        else if (args[i] == "--trace") tracePath = args[i + 1];
+        else if (args[i] == "--trace-sample") traceSample = std::stoul(args[i + 1]);
+    }
+    SearchTracer tracer;
+    if (!tracePath.empty() && !openTrace(tracer, tracePath, traceSample)) {
+        return 1;
+    }
+    if (window == 0) {
+        window = 64 * (size_t) threads;
+    }
+    std::ifstream inputFile;
+    std::ofstream outputFile;
+    if (inputPath != "-") {
+        inputFile.open(inputPath);
+        if (!inputFile) {
+            std::cerr << "Cannot read " << inputPath << std::endl;
+            return 1;
         }
+    }
+    if (outputPath != "-") {
+        outputFile.open(outputPath);
+    }
+    std::istream &input = inputPath == "-" ? std::cin : inputFile;
+    std::ostream &output = outputPath == "-" ? std::cout : outputFile;
+    Tablebases tablebases;
+    if (!tablebaseDir.empty()) {
+        tablebases.load(tablebaseDir);
+    }
+    auto network = std::make_unique<NNUENetwork>();
+    if (!networkPath.empty() && !loadNetwork(networkPath, *network)) {
+        std::cerr << "Cannot load network " << networkPath << std::endl;
+        return 1;
+    }
 
-        int itAlphaBetaNegamaxWithTT(const Board &board, int depth, int initDepth, int alpha, int beta,
-                                     std::chrono::duration<double> timeLimit) {
-            auto currTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-            if (currTime - startTime >= timeLimit) {
-                LastCompletedDepth = initDepth - 1;
-                return -INF;
+    std::mutex lock;
+    std::condition_variable space;
+    size_t nextRead = 0, nextWrite = 0;
+    bool finished = false;
+    std::map<size_t, std::string> pending;
+
+    parallelFor(threads, 1, threads, [&](size_t, size_t) {
+        MiniMax mm;
+        mm.setHashSize(hashMB);
+        mm.setTablebases(tablebases.size() > 0 ? &tablebases : nullptr);
+        mm.setNodeLimit(nodes);
+        mm.setNetwork(networkPath.empty() ? nullptr : network.get());
+        mm.setTracer(tracePath.empty() ? nullptr : &tracer);
+        while (true) {
+            std::string fen;
+            size_t sequence;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                space.wait(guard, [&]() { return finished || nextRead < nextWrite + window; });
+                if (finished || !getline(input, fen)) {
+                    finished = true;
+                    space.notify_all();
+                    return;
+                }
+                sequence = nextRead++;
             }
 
-            int origAlpha = alpha;
-            HashEntry *entry = GetTranspositionEntry(board);
-            int ttDepth = -1;
-            std::string ttMove, localBestMove = bestMove;
-            FLAG ttFlag;
-            int ttScore;
-            char toPlay = board.getToPlay();
-            if (entry != nullptr) {
-                ttDepth = entry->depth;
-                ttMove = entry->move;
-                ttFlag = entry->flag;
-                ttScore = entry->score;
-                if (entry->toPlay != toPlay) {
-                    ttScore *= -1;
-                }
-                if (ttDepth >= depth && ttDepth != initDepth) {
+            fen.erase(fen.find_last_not_of(" \t\r") + 1);
+            bool skip = fen.empty() || fen[0] == '#';
+            std::string result = skip ? "" : analysePosition(mm, fen, depth, timeLimit);
 
-                    if (ttFlag == EXACT) {
-                        return ttScore;
-                    } else if (ttFlag == LOWERBOUND) {
-                        alpha = std::max(alpha, ttScore);
-                    } else if (ttFlag == UPPERBOUND) {
-                        beta = std::min(beta, ttScore);
-                    }
-                    if (alpha >= beta) {
-                        return ttScore;
-                    }
+            std::lock_guard<std::mutex> guard(lock);
+            pending[sequence] = result;
+            for (auto it = pending.begin(); it != pending.end() && it->first == nextWrite; it = pending.erase(it)) {
+                if (!it->second.empty()) {
+                    output << it->second << "\n";
                 }
-
-            }
-
-            if (depth == 0 || board.isGameOver() != 'n') {
-                LastCompletedDepth = initDepth;
-                return boardEvaluation(board);
+                ++nextWrite;
             }
-            int value;
+            output.flush();
+            space.notify_all();
+        }
+    });
+    return 0;
+}
 
-            value = negINF;
-            auto moves = board.GenerateAllLegalMoves();
+/*
+ * congo trace json|dot trace.bin [output]
+ *
+ * Converts a trace file written with --trace. json writes one object per event in file order; dot draws the
+ * sampled nodes of each searcher linked to their nearest sampled ancestor, labelled with the move, depth, window
+ * and score, and the table hits, stores and cutoff of the node.
+ */
+int trace(const std::vector<std::string> &args) {
+    if (args.size() < 3 || (args[1] != "json" && args[1] != "dot")) {
+        std::cerr << "Usage: congo trace json|dot trace.bin [output]" << std::endl;
+        return 1;
+    }
+    std::ifstream in(args[2], std::ios::binary);
+    TraceHeader header{};
+    in.read((char *) &header, sizeof(header));
+    if (!in || std::string(header.magic, 4) != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        std::cerr << "Not a trace file: " << args[2] << std::endl;
+        return 1;
+    }
+    std::vector<std::pair<unsigned int, TraceEvent>> events;
+    TraceBlock block{};
+    while (in.read((char *) &block, sizeof(block))) {
+        std::vector<TraceEvent> ring(block.count);
+        if (!in.read((char *) ring.data(), (std::streamsize) (block.count * sizeof(TraceEvent)))) {
+            std::cerr << "Truncated trace block" << std::endl;
+            return 1;
+        }
+        for (const auto &e: ring) {
+            events.emplace_back(block.searcher, e);
+        }
+    }
 
-            for (const auto &m: moves) {
-                alpha = std::max(value, alpha);
-                auto nextState = board;
-                nextState.makeMove(m);
-                int childVal = -itAlphaBetaNegamaxWithTT(nextState, depth - 1, initDepth, -beta, -alpha, timeLimit);
-                localBestMove = m;
-                if (childVal > value) {
-                    value = childVal;
-                    if (depth == initDepth) {
-                        bestMove = m;
-                    }
-                }
-                alpha = std::max(alpha, value);
-                if (alpha >= beta) {
+    std::ofstream outputFile;
+    if (args.size() > 3) {
+        outputFile.open(args[3]);
+    }
+    std::ostream &out = args.size() > 3 ? outputFile : std::cout;
+    const char *types[] = {"enter", "exit", "hit", "store", "cutoff"};
+    const char *flags[] = {"exact", "lower", "upper"};
+    auto move = [](unsigned short m) { return m == 0 ? std::string() : decodeMove(m); };
+    auto flag = [&](int f) { return f >= 0 && f < 3 ? flags[f] : "?"; };
+
+    if (args[1] == "json") {
+        for (const auto &item: events) {
+            const TraceEvent &e = item.second;
+            out << "{\"searcher\":" << item.first << ",\"node\":" << e.node << ",\"type\":\""
+                << (e.type < 5 ? types[e.type] : "?") << "\",\"depth\":" << (int) e.depth;
+            switch (e.type) {
+                case TraceEnter:
+                    out << ",\"alpha\":" << e.alpha << ",\"beta\":" << e.beta << ",\"move\":\"" << move(e.move)
+                        << "\",\"parent\":" << e.data;
+                    break;
+                case TraceExit:
+                    out << ",\"alpha\":" << e.alpha << ",\"beta\":" << e.beta << ",\"score\":" << e.score;
+                    break;
+                case TraceHit:
+                case TraceStore:
+                    out << ",\"flag\":\"" << flag(e.alpha) << "\",\"score\":" << e.score << ",\"move\":\""
+                        << move(e.move) << "\",\"key\":\"" << std::hex << e.data << std::dec << "\"";
+                    break;
+                case TraceCutoff:
+                    out << ",\"alpha\":" << e.alpha << ",\"beta\":" << e.beta << ",\"score\":" << e.score
+                        << ",\"move\":\"" << move(e.move) << "\",\"tried\":" << e.data;
                     break;
-                }
             }
+            out << "}\n";
+        }
+        return 0;
+    }
 
-            FLAG flag = EXACT;
-            if (value <= origAlpha)
-                flag = UPPERBOUND;
-            else if (value >= beta)
-                flag = LOWERBOUND;
+    struct TraceNodeLabel {
+        unsigned long long parent = 0;
+        std::string text;
+    };
+    std::map<std::pair<unsigned int, unsigned long long>, TraceNodeLabel> nodes;
+    for (const auto &item: events) {
+        const TraceEvent &e = item.second;
+        auto &node = nodes[{item.first, e.node}];
+        std::ostringstream text;
+        switch (e.type) {
+            case TraceEnter:
+                node.parent = e.data;
+                text << (e.move == 0 ? "root" : move(e.move)) << " d" << (int) e.depth << " [" << e.alpha << ", "
+                     << e.beta << "]";
+                break;
+            case TraceExit:
+                text << "\\n= " << e.score;
+                break;
+            case TraceHit:
+            case TraceStore:
+                text << "\\n" << (e.type == TraceHit ? "hit " : "store ") << flag(e.alpha) << " d" << (int) e.depth
+                     << " " << e.score << " " << move(e.move);
+                break;
+            case TraceCutoff:
+                text << "\\ncut " << move(e.move) << " (" << e.data << " tried)";
+                break;
+        }
+        node.text += text.str();
+    }
+    out << "digraph trace {\n    node [shape=box, fontname=monospace];\n";
+    for (const auto &n: nodes) {
+        std::string id = std::to_string(n.first.first) + "." + std::to_string(n.first.second);
+        out << "    \"" << id << "\" [label=\"" << n.second.text << "\"];\n";
+        if (n.second.parent != 0 && nodes.count({n.first.first, n.second.parent})) {
+            out << "    \"" << n.first.first << "." << n.second.parent << "\" -> \"" << id << "\";\n";
+        }
+    }
+    out << "}\n";
+    return 0;
+}
 
-            auto newEntry = new HashEntry(depth, value, flag, localBestMove, toPlay);
-            storeEntry(board, newEntry);
+/*
+ * Self-play file: a SelfPlayHeader followed by SelfPlayRecord entries up to the end of the file, appended
+ * game by game as they finish. Scores and results are from white's point of view.
+ */
+struct SelfPlayHeader {
+    char magic[4];
+    unsigned int version;
+};
+
+struct SelfPlayRecord {
+    unsigned char squares[25];
+    unsigned char black;
+    short score;
+    unsigned short ply;
+    signed char result;
+    unsigned char reserved;
+};
+
+struct SelfPlaySettings {
+    int depth = 0;
+    unsigned long long nodes = 2000;
+    int randomPlies = 8;
+    int maxPlies = 300;
+};
 
+/*
+ * Plays one game from the start position: randomPlies random moves, then every position is searched to
+ * settings.depth (or within settings.nodes) and recorded. Returns 'w', 'b', 'd', or 'n' when the random
+ * opening already ended the game and nothing was recorded.
+ */
+char playSelfPlayGame(Engine &engine, const SelfPlaySettings &settings, unsigned int seed,
+                      std::vector<SelfPlayRecord> &records) {
+    std::mt19937 gen(seed);
+    engine.setPosition(START_FEN);
+    const Board &board = engine.getBoard();
+    for (int ply = 0; ply < settings.randomPlies && board.isGameOver() == 'n'; ++ply) {
+        auto moves = board.GenerateAllLegalMoves();
+        engine.applyMove(*select_randomly(moves.begin(), moves.end(), gen));
+    }
+    if (board.isGameOver() != 'n') {
+        return 'n';
+    }
 
-            return value;
+    engine.getMiniMax().clearTranspositionTable();
+    SearchLimits limits;
+    limits.iterative = settings.depth == 0;
+    limits.depth = settings.depth > 0 ? settings.depth : 50;
+    limits.nodes = settings.nodes;
+    size_t first = records.size();
+    char winner = 'd';
+    for (int ply = settings.randomPlies; ply < settings.maxPlies; ++ply) {
+        winner = engine.isGameOver();
+        if (winner != 'n') {
+            break;
         }
-
-        std::string getBestMove() {
-            return bestMove;
+        winner = 'd';
+        std::string move = engine.search(limits);
+        if (move.empty()) {
+            winner = flipColour(board.getToPlay());
+            break;
         }
-    };
-
+        SelfPlayRecord record{};
+        packSquares(board.getBoard(), record.squares);
+        record.black = board.getToPlay() == 'b';
+        int score = std::max(-32000, std::min(32000, engine.getLastScore()));
+        record.score = (short) (record.black ? -score : score);
+        record.ply = (unsigned short) ply;
+        records.push_back(record);
+        engine.applyMove(move);
+    }
+    for (size_t i = first; i < records.size(); ++i) {
+        records[i].result = (signed char) (winner == 'w' ? 1 : winner == 'b' ? -1 : 0);
+    }
+    return winner;
+}
 
-    Board
-    playBoardNegamaxGame(std::string fen, int depth, int mode, char toPlayAs, int oppMode, int oppDepth = 2,
-                         bool ID = false, bool oppID = false,
-                         int myTime = 10, int oppTime = 10) {
-        int moveCount = 0;
-        auto board = Board(fen);
-        auto myMinimax = new MiniMax;
-        auto oppMinimax = new MiniMax;
-        std::vector<std::string> LegalMoves;
+/*
+ * congo selfplay [--games n] [--threads n] [--nodes n | --depth n] [--random-plies n] [--max-plies n]
+ *                [--hash mb] [--seed n] [--output selfplay.bin]
+ * Plays games on a pool of threads, game g with the generator seeded seed + g, and appends the records of
+ * finished games to the output in batches.
+ */
+int selfplay(const std::vector<std::string> &args) {
+    SelfPlaySettings settings;
+    int games = 1000;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    int hashMB = 2;
+    unsigned int seed = BENCH_SEED;
+    std::string outputPath = "selfplay.bin";
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--games") games = std::stoi(args[i + 1]);
+        else if (args[i] == "--threads") threads = std::stoi(args[i + 1]);
+        else if (args[i] == "--nodes") settings.nodes = std::stoull(args[i + 1]);
+        else if (args[i] == "--depth") settings.depth = std::stoi(args[i + 1]);
+        else if (args[i] == "--random-plies") settings.randomPlies = std::stoi(args[i + 1]);
+        else if (args[i] == "--max-plies") settings.maxPlies = std::stoi(args[i + 1]);
+        else if (args[i] == "--hash") hashMB = std::stoi(args[i + 1]);
+        else if (args[i] == "--seed") seed = std::stoul(args[i + 1]);
+        else if (args[i] == "--output") outputPath = args[i + 1];
+    }
 
-        char gameOver = board.isGameOver();
-        std::cout << fen << std::endl;
-        int moveIndex = 0;
-        while (gameOver == 'n') {
-            std::string move;
-            if (findToPlay(fen) == toPlayAs) {
-                if (ID) {
-                    move = myMinimax->iterativeDeepening(fen, 50, mode, myTime);
-                } else {
-                    move = myMinimax->getBestMoveNegamax(fen, depth, mode);
-                }
-            } else {
-                if (oppMode == ORDERED) {
-                    auto x = board.GenerateAllLegalMoves();
-                    if (moveIndex >= x.size()) {
-                        moveIndex = 0;
-                    }
-                    move = x[moveIndex];
-                    moveIndex++;
-                } else if (oppMode == RANDOM) {
-                    auto x = board.GenerateAllLegalMoves();
-                    move = getRandomMove(x);
-                } else {
-                    if (ID)
-                        move = oppMinimax->iterativeDeepening(fen, 50, oppMode, oppTime);
-                    else
-                        move = oppMinimax->getBestMoveNegamax(fen, oppDepth, oppMode);
-                }
+    std::ofstream output(outputPath, std::ios::binary);
+    if (!output) {
+        std::cerr << "Can't write " << outputPath << std::endl;
+        return 1;
+    }
+    SelfPlayHeader header{};
+    std::copy(SELFPLAY_MAGIC, SELFPLAY_MAGIC + 4, header.magic);
+    header.version = SELFPLAY_VERSION;
+    output.write((const char *) &header, sizeof(header));
+
+    std::mutex lock;
+    std::atomic<int> nextGame(0);
+    unsigned long long positions = 0;
+    int finished = 0, wins = 0, draws = 0, losses = 0;
+    auto start = std::chrono::steady_clock::now();
+    const size_t flushSize = 1 << 14;
+    parallelFor(threads, 1, threads, [&](size_t, size_t) {
+        Engine engine;
+        engine.getMiniMax().setHashSize(hashMB);
+        std::vector<SelfPlayRecord> records;
+        auto flush = [&]() {
+            output.write((const char *) records.data(), (std::streamsize) (records.size() * sizeof(SelfPlayRecord)));
+            positions += records.size();
+            records.clear();
+        };
+        for (int g = nextGame++; g < games; g = nextGame++) {
+            char winner = playSelfPlayGame(engine, settings, seed + (unsigned int) g, records);
+            std::lock_guard<std::mutex> guard(lock);
+            if (winner != 'n') {
+                finished++;
+                wins += winner == 'w';
+                draws += winner == 'd';
+                losses += winner == 'b';
             }
-            if (findToPlay(fen) == 'b') {
-                moveCount++;
+            if (records.size() >= flushSize) {
+                flush();
             }
-            board.makeMove(move);
-            fen = board.getFen();
-            std::cout << move << " -> " << fen << std::endl;
-            gameOver = board.isGameOver();
-            if (moveCount == 100) {
-                gameOver = 'd';
+            if (finished % 100 == 0 && winner != 'n') {
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << "Games: " << finished << " +" << wins << " =" << draws << " -" << losses
+                          << " positions: " << positions << " (" << (int) (positions / elapsed.count())
+                          << "/s)" << std::endl;
             }
         }
-        std::cout << "Winner is: " << gameOver << std::endl;
-        return board;
+        std::lock_guard<std::mutex> guard(lock);
+        flush();
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Wrote " << positions << " positions from " << finished << " games to " << outputPath << " in "
+              << elapsed.count() << "s" << std::endl;
+    return 0;
+}
+
+/*
+ * congo gamedb import <log.txt> [games.cgdb]   converts playBoardNegamaxGame logs (a FEN line, "move -> fen"
+ *                                               lines and "Winner is: x") into a game database
+ * congo gamedb info <games.cgdb>                counts the games and times a replay of every position
+ * congo gamedb find <games.cgdb> <fen>          lists the games and plies where the position occurs
+ * congo gamedb show <games.cgdb> <game>         prints one game
+ */
+int gamedb(const std::vector<std::string> &args) {
+    if (args.size() < 3) {
+        std::cerr << "Usage: congo gamedb import|info|find|show <file> ..." << std::endl;
+        return 1;
+    }
+    const std::string &command = args[1];
+    if (command == "import") {
+        std::ifstream input(args[2]);
+        std::string outputPath = args.size() > 3 ? args[3] : "games.cgdb";
+        GameDatabaseWriter writer;
+        std::string start, line;
+        std::vector<std::string> moves;
+        auto finish = [&](char result) {
+            if (!start.empty()) {
+                writer.addGame(Board(start), moves, result);
+            }
+            start.clear();
+            moves.clear();
+        };
+        while (getline(input, line)) {
+            size_t arrow = line.find(" -> ");
+            if (arrow != std::string::npos && !start.empty()) {
+                moves.push_back(line.substr(0, arrow));
+            } else if (line.rfind("Winner is: ", 0) == 0) {
+                finish(line.back());
+            } else if (line.find('/') != std::string::npos && std::count(line.begin(), line.end(), ' ') == 2) {
+                finish('n');
+                start = line;
+            }
+        }
+        finish('n');
+        if (!writer.write(outputPath)) {
+            std::cerr << "Can't write " << outputPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << writer.size() << " games to " << outputPath << std::endl;
+        return 0;
     }
 
+    GameDatabase database;
+    if (!database.open(args[2])) {
+        std::cerr << "Can't open " << args[2] << std::endl;
+        return 1;
+    }
+    if (command == "info") {
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long replayed = 0;
+        for (size_t g = 0; g < database.size(); ++g) {
+            database.replay(g, [&](const Board &, int) {
+                replayed++;
+                return true;
+            });
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << database.size() << " games, " << database.positionsSize() << " positions; replayed "
+                  << replayed << " in " << elapsed.count() << "s (" << (long long) (replayed / elapsed.count())
+                  << "/s)" << std::endl;
+    } else if (command == "find" && args.size() > 3) {
+        MiniMax keys;
+        for (const auto &hit: database.find(keys.positionKey(Board(args[3])))) {
+            std::cout << "game " << hit.first << " ply " << hit.second << std::endl;
+        }
+    } else if (command == "show" && args.size() > 3) {
+        size_t index = std::stoul(args[3]);
+        if (index >= database.size()) {
+            return 1;
+        }
+        std::cout << Board(database.game(index).start).getFen() << std::endl;
+        printMoves(database.getMoves(index));
+        std::cout << "Winner is: " << database.game(index).result << std::endl;
+    }
+    return 0;
 }
 
+/*
+ * Tuning positions are the linear part of boardEvaluation, precomputed: the pieces as type * 49 + square
+ * (black squares turned around, 0x8000 set for black), and the white minus black mobility, attack and lion
+ * attack counts. The weights vector is the six piece-square tables, the pawn, elephant, zebra, monkey and
+ * crocodile values, then the mobility, attack and lion attack weights.
+ */
+struct TuningPosition {
+    float result;
+    short mobility;
+    signed char attacks;
+    signed char lionAttacks;
+    unsigned char count;
+    unsigned short pieces[TUNE_MAX_PIECES];
+};
+
+//Piece-square tables in this order, then the values of the pieces before the lion
+const std::string TunePieceTypes = "PEZMCL";
+const int TuneValueTypes = 5;
+const int TuneValueIndex = 6 * 49;
+const int TuneMobilityIndex = TuneValueIndex + TuneValueTypes;
+const int TuneAttackIndex = TuneMobilityIndex + 1;
+const int TuneLionAttackIndex = TuneAttackIndex + 1;
+const int TuneWeightCount = TuneLionAttackIndex + 1;
+
+std::vector<double> getEvaluationWeights() {
+    std::vector<double> weights(TuneWeightCount);
+    const std::array<int, 49> *tables[] = {&PawnSquareTable, &ElephantSquareTable, &ZebraSquareTable,
+                                           &MonkeySquareTable, &CrocodileSquareTable, &LionSquareTable};
+    for (int t = 0; t < 6; ++t) {
+        std::copy(tables[t]->begin(), tables[t]->end(), weights.begin() + t * 49);
+    }
+    weights[TuneValueIndex] = PawnValue;
+    weights[TuneValueIndex + 1] = ElephantValue;
+    weights[TuneValueIndex + 2] = ZebraValue;
+    weights[TuneValueIndex + 3] = MonkeyValue;
+    weights[TuneValueIndex + 4] = CrocodileValue;
+    weights[TuneMobilityIndex] = MobilityWeight;
+    weights[TuneAttackIndex] = AttackWeight;
+    weights[TuneLionAttackIndex] = LionAttackWeight;
+    return weights;
+}
 
-using namespace Congo;
+//False for positions boardEvaluation does not score linearly: finished games and bare lions
+bool getTuningPosition(const Board &board, float result, TuningPosition &position) {
+    if (board.isGameOver() != 'n') {
+        return false;
+    }
+    auto squares = board.getBoard();
+    position = TuningPosition();
+    position.result = result;
+    int others = 0;
+    for (int i = 0; i < 49; ++i) {
+        if (squares[i] == '_') {
+            continue;
+        }
+        if (position.count == TUNE_MAX_PIECES) {
+            return false;
+        }
+        bool white = isupper(squares[i]);
+        int type = (int) TunePieceTypes.find((char) toupper(squares[i]));
+        position.pieces[position.count++] = (unsigned short) (type * 49 + (white ? i : 48 - i) + (white ? 0 : 0x8000));
+        others += type != TuneValueTypes;
+    }
+    if (others == 0) {
+        return false;
+    }
 
-void FullGameTime(int depth) {
-    std::ofstream output("FullGameResults.txt", std::ios::app);
-
-    output << "Depth: " << depth << std::endl;
-    std::string startFen = "2ele1z/ppppppp/7/7/7/PPPPPPP/2ELE1Z w 0";
-
-    if (depth < 5) {
-        auto start1 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-        output << "Standard" << std::endl;
-        Board STD = playBoardNegamaxGame(startFen, depth, STANDARD, 'b', ORDERED);
-        output << "Winner: " << STD.isGameOver() << std::endl;
-        output << "Moves: " << STD.getTurnNum() << std::endl;
-        auto end1 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-        auto diff1 = end1 - start1;
-        output << "Time: " << diff1.count() << std::endl << std::endl;
-    }
-
-    auto start2 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    output << "Alpha Beta" << std::endl;
-    Board AB = playBoardNegamaxGame(startFen, depth, ALPHA_BETA, 'b', ORDERED);
-    output << "Winner: " << AB.isGameOver() << std::endl;
-    output << "Moves: " << AB.getTurnNum() << std::endl;
-    auto end2 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    auto diff2 = end2 - start2;
-    output << "Time: " << diff2.count() << std::endl << std::endl;
-
-    auto start3 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    output << "Transposition Table" << std::endl;
-    Board TT = playBoardNegamaxGame(startFen, depth, TRANSPOSITION_TABLES, 'b', ORDERED);
-    output << "Winner: " << TT.isGameOver() << std::endl;
-    output << "Moves: " << TT.getTurnNum() << std::endl;
-    auto end3 = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    auto diff3 = end3 - start3;
-    output << "Time: " << diff3.count() << std::endl;
-
-    output << std::endl << std::endl;
-    output.close();
+    Board other = board;
+    other.flipToPlay();
+    const Board &white = board.getToPlay() == 'w' ? board : other;
+    const Board &black = board.getToPlay() == 'w' ? other : board;
+    auto whiteMoves = white.GenerateAllLegalMoves();
+    auto blackMoves = black.GenerateAllLegalMoves();
+    position.mobility = (short) (whiteMoves.size() - blackMoves.size());
+    int attacks = 0, lionAttacks = 0;
+    for (const auto &m: whiteMoves) {
+        char target = getMoveTarget(squares, m);
+        attacks += islower(target) ? 1 : 0;
+        lionAttacks += target == 'l' ? 1 : 0;
+    }
+    for (const auto &m: blackMoves) {
+        char target = getMoveTarget(squares, m);
+        attacks -= isupper(target) ? 1 : 0;
+        lionAttacks -= target == 'L' ? 1 : 0;
+    }
+    position.attacks = (signed char) attacks;
+    position.lionAttacks = (signed char) lionAttacks;
+    return true;
 }
 
-void ID_Output(int time, int Mode, const std::string &filename, const std::string &fen) {
-    std::ofstream output(filename);
-    auto mm = MiniMax();
-    int maxDepth = 20;
-    auto Arr = mm.iterativeDeepeningOutput(fen, maxDepth, Mode, time);
-    for (const auto &i: Arr) {
-        output << i;
+//boardEvaluation from white's side for a tuning position
+double linearEvaluation(const std::vector<double> &weights, const TuningPosition &position) {
+    double eval = weights[TuneMobilityIndex] * position.mobility + weights[TuneAttackIndex] * position.attacks +
+                  weights[TuneLionAttackIndex] * position.lionAttacks;
+    for (int i = 0; i < position.count; ++i) {
+        int feature = position.pieces[i] & 0x7FFF;
+        int type = feature / 49;
+        double value = weights[feature] + (type < TuneValueTypes ? weights[TuneValueIndex + type] : 0);
+        eval += position.pieces[i] & 0x8000 ? -value : value;
     }
-    output.close();
+    return eval;
 }
 
-void saveIDResults(int time, const std::string &fen) {
-    ID_Output(time, STANDARD, "ID_Standard.txt", fen);
-    ID_Output(time, ALPHA_BETA, "ID_AlphaBeta.txt", fen);
-    ID_Output(time, TRANSPOSITION_TABLES, "ID_Transposition.txt", fen);
+//Expected score for white from an evaluation, a logistic curve with scale k
+double winProbability(double eval, double k) {
+    return 1 / (1 + std::pow(10.0, -k * eval / 400));
 }
 
-void Negamax_Output(int depth, int Mode, const std::string &filename, const std::string &fen) {
-    std::ofstream output(filename, std::ios::app);
-
-    MiniMax mm = MiniMax();
-    Board board = Board(fen);
-    int score = mm.INF;
-    auto start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    std::string modeName;
-
-    if (Mode == STANDARD) {
-        modeName = "Standard";
-        score = mm.negamax(board, depth, depth);
-    } else if (Mode == ALPHA_BETA) {
-        modeName = "Alpha Beta";
-        score = mm.AlphaBetaNegamax(board, depth, depth, mm.negINF, mm.INF);
-    } else if (Mode == TRANSPOSITION_TABLES) {
-        modeName = "Transposition Table";
-        score = mm.AlphaBetaNegamaxWithTT(board, depth, depth, mm.negINF, mm.INF);
-    }
-
-    auto end = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch());
-    auto timeTaken = end - start;
-    output << "Mode: " << modeName << std::endl;
-    output << "Depth: " << depth << std::endl;
-    output << "Score: " << score << std::endl;
-    output << "Move: " << mm.getBestMove() << std::endl;
-    output << "Time: " << timeTaken.count() << std::endl;
-    output << std::endl << std::endl;
-    output.close();
+/*
+ * Reads "fen;result" lines, the result being white's score as 1, 0.5 or 0 (or 1-0, 1/2-1/2, 0-1), parsing
+ * blocks of lines in parallel. Unusable positions are dropped; malformed lines are skipped and counted.
+ */
+std::vector<TuningPosition> loadTuningPositions(const std::string &path, int threads) {
+    std::vector<TuningPosition> positions;
+    std::ifstream input(path, std::ios::binary);
+    const size_t block = 1 << 16;
+
+    SelfPlayHeader header{};
+    input.read((char *) &header, sizeof(header));
+    if (input && std::string(header.magic, 4) == SELFPLAY_MAGIC && header.version == SELFPLAY_VERSION) {
+        std::vector<SelfPlayRecord> records(block);
+        while (input) {
+            input.read((char *) records.data(), (std::streamsize) (block * sizeof(SelfPlayRecord)));
+            size_t count = input.gcount() / sizeof(SelfPlayRecord);
+            std::vector<TuningPosition> parsed(count);
+            std::vector<char> valid(count, 0);
+            parallelFor(count, 256, threads, [&](size_t begin, size_t end) {
+                std::array<char, 49> b{};
+                for (size_t i = begin; i < end; ++i) {
+                    unpackSquares(records[i].squares, b);
+                    Board board(b, records[i].black ? 'b' : 'w', records[i].ply / 2);
+                    valid[i] = getTuningPosition(board, (records[i].result + 1) / 2.0f, parsed[i]);
+                }
+            });
+            for (size_t i = 0; i < count; ++i) {
+                if (valid[i]) {
+                    positions.push_back(parsed[i]);
+                }
+            }
+        }
+        return positions;
+    }
+    input.clear();
+    input.seekg(0);
+
+    std::vector<std::string> lines;
+    size_t malformed = 0;
+    while (input) {
+        lines.clear();
+        std::string line;
+        while (lines.size() < block && getline(input, line)) {
+            if (!line.empty() && line[0] != '#') {
+                lines.push_back(line);
+            }
+        }
+        std::vector<TuningPosition> parsed(lines.size());
+        //1 for a position, 0 for an unusable one and 2 for a malformed line
+        std::vector<char> valid(lines.size(), 2);
+        parallelFor(lines.size(), 256, threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t separator = lines[i].find(';');
+                if (separator == std::string::npos) {
+                    continue;
+                }
+                std::string fen = lines[i].substr(0, separator);
+                std::string label = lines[i].substr(separator + 1);
+                for (std::string *field: {&fen, &label}) {
+                    field->erase(0, field->find_first_not_of(" \t\r"));
+                    field->erase(field->find_last_not_of(" \t\r") + 1);
+                }
+                float result;
+                if (label == "1-0" || label == "0-1" || label == "1/2-1/2") {
+                    result = label == "1-0" ? 1.0f : label == "0-1" ? 0.0f : 0.5f;
+                } else {
+                    char *parsedEnd = nullptr;
+                    result = std::strtof(label.c_str(), &parsedEnd);
+                    if (label.empty() || *parsedEnd != '\0' || !(result >= 0 && result <= 1)) {
+                        continue;
+                    }
+                }
+                if (!isValidFen(fen)) {
+                    continue;
+                }
+                valid[i] = getTuningPosition(Board(fen), result, parsed[i]);
+            }
+        });
+        for (size_t i = 0; i < parsed.size(); ++i) {
+            if (valid[i] == 1) {
+                positions.push_back(parsed[i]);
+            }
+            malformed += valid[i] == 2;
+        }
+    }
+    if (malformed > 0) {
+        std::cerr << "Skipped " << malformed << " malformed lines in " << path << std::endl;
+    }
+    return positions;
+}
+
+//Mean squared error of the predicted scores, and its gradient when gradient is not null
+double tuningError(const std::vector<TuningPosition> &positions, const std::vector<double> &weights, double k,
+                   int threads, std::vector<double> *gradient) {
+    const size_t chunk = std::max<size_t>(1024, positions.size() / 256 + 1);
+    size_t chunks = (positions.size() + chunk - 1) / chunk;
+    std::vector<double> errors(chunks, 0);
+    std::vector<std::vector<double>> gradients(gradient != nullptr ? chunks : 0);
+    const double slope = k * std::log(10.0) / 400;
+    parallelFor(positions.size(), chunk, threads, [&](size_t begin, size_t end) {
+        size_t c = begin / chunk;
+        std::vector<double> local(gradient != nullptr ? TuneWeightCount : 0, 0);
+        double error = 0;
+        for (size_t p = begin; p < end; ++p) {
+            const TuningPosition &position = positions[p];
+            double predicted = winProbability(linearEvaluation(weights, position), k);
+            double difference = position.result - predicted;
+            error += difference * difference;
+            if (gradient == nullptr) {
+                continue;
+            }
+            double d = -2 * difference * predicted * (1 - predicted) * slope;
+            local[TuneMobilityIndex] += d * position.mobility;
+            local[TuneAttackIndex] += d * position.attacks;
+            local[TuneLionAttackIndex] += d * position.lionAttacks;
+            for (int i = 0; i < position.count; ++i) {
+                int feature = position.pieces[i] & 0x7FFF;
+                int type = feature / 49;
+                double signedD = position.pieces[i] & 0x8000 ? -d : d;
+                local[feature] += signedD;
+                if (type < TuneValueTypes) {
+                    local[TuneValueIndex + type] += signedD;
+                }
+            }
+        }
+        errors[c] = error;
+        if (gradient != nullptr) {
+            gradients[c] = std::move(local);
+        }
+    });
+    double total = 0;
+    for (double e: errors) {
+        total += e;
+    }
+    if (gradient != nullptr) {
+        gradient->assign(TuneWeightCount, 0);
+        for (const auto &g: gradients) {
+            for (int i = 0; i < TuneWeightCount; ++i) {
+                (*gradient)[i] += g[i] / (double) positions.size();
+            }
+        }
+    }
+    return total / (double) std::max<size_t>(1, positions.size());
 }
 
-void saveNegamaxResults(int depth, const std::string &fen) {
-    std::string filename = "NegamaxResults.txt";
-    //remove("NegamaxResults.txt");
-    if (depth < 5)Negamax_Output(depth, STANDARD, filename, fen);
-    Negamax_Output(depth, ALPHA_BETA, filename, fen);
-    Negamax_Output(depth, TRANSPOSITION_TABLES, filename, fen);
+void writeWeightsHeader(const std::string &path, const std::vector<double> &weights) {
+    std::ofstream output(path);
+    auto value = [&](int i) { return (int) std::lround(weights[i]); };
+    output << "//Evaluation weights in centipawns from white's side. ./congo tune rewrites this file with fitted values.\n"
+              "#ifndef CONGO_WEIGHTS_H\n#define CONGO_WEIGHTS_H\n\n#include <array>\n\n";
+    output << "constexpr int PawnValue = " << value(TuneValueIndex) << ";\n";
+    output << "constexpr int ElephantValue = " << value(TuneValueIndex + 1) << ";\n";
+    output << "constexpr int ZebraValue = " << value(TuneValueIndex + 2) << ";\n";
+    output << "constexpr int MonkeyValue = " << value(TuneValueIndex + 3) << ";\n";
+    output << "constexpr int CrocodileValue = " << value(TuneValueIndex + 4) << ";\n";
+    output << "constexpr int MobilityWeight = " << value(TuneMobilityIndex) << ";\n";
+    output << "constexpr int AttackWeight = " << value(TuneAttackIndex) << ";\n";
+    output << "constexpr int LionAttackWeight = " << value(TuneLionAttackIndex) << ";\n\n";
+    output << "//Piece-square tables for white pieces, a7 (index 0) to g1 (index 48); black pieces use index 48 - square\n";
+    const char *names[] = {"Pawn", "Elephant", "Zebra", "Monkey", "Crocodile", "Lion"};
+    for (int t = 0; t < 6; ++t) {
+        output << "constexpr std::array<int, 49> " << names[t] << "SquareTable =\n        {";
+        for (int i = 0; i < 49; ++i) {
+            output << value(t * 49 + i) << (i == 48 ? "};\n" : i % 7 == 6 ? ",\n         " : ", ");
+        }
+    }
+    output << "\n#endif //CONGO_WEIGHTS_H\n";
 }
 
+/*
+ * congo tune --data positions.txt [--epochs n] [--rate r] [--k k] [--fit-k] [--threads n] [--output file]
+ *
+ * Fits the boardEvaluation weights to game results by minimising the squared error of a logistic of the
+ * linear evaluation with Adam, starting from the compiled in weights, and writes them as congo_weights.h
+ * (by default) to be compiled into the next build.
+ */
+int tune(const std::vector<std::string> &args) {
+    std::string dataPath, outputPath = "congo_weights.h";
+    int epochs = 100;
+    double rate = 1.0, k = 1.0;
+    bool fitK = false;
+    int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--fit-k") fitK = true;
+        else if (i + 1 >= args.size()) break;
+        else if (args[i] == "--data") dataPath = args[++i];
+        else if (args[i] == "--epochs") epochs = std::stoi(args[++i]);
+        else if (args[i] == "--rate") rate = std::stod(args[++i]);
+        else if (args[i] == "--k") k = std::stod(args[++i]);
+        else if (args[i] == "--threads") threads = std::stoi(args[++i]);
+        else if (args[i] == "--output") outputPath = args[++i];
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto positions = loadTuningPositions(dataPath, threads);
+    std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << positions.size() << " positions (" << positions.size() * sizeof(TuningPosition) / 1048576
+              << "MB) in " << loadTime.count() << "s" << std::endl;
+    if (positions.empty()) {
+        return 1;
+    }
+
+    std::vector<double> weights = getEvaluationWeights();
+    if (fitK) {
+        double bestError = tuningError(positions, weights, k, threads, nullptr);
+        for (double candidate = 0.1; candidate <= 3.0; candidate += 0.05) {
+            double error = tuningError(positions, weights, candidate, threads, nullptr);
+            if (error < bestError) {
+                bestError = error;
+                k = candidate;
+            }
+        }
+        std::cout << "K: " << k << " Error: " << bestError << std::endl;
+    }
+
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    std::vector<double> gradient, m(TuneWeightCount, 0), v(TuneWeightCount, 0);
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        auto epochStart = std::chrono::steady_clock::now();
+        double error = tuningError(positions, weights, k, threads, &gradient);
+        for (int i = 0; i < TuneWeightCount; ++i) {
+            m[i] = beta1 * m[i] + (1 - beta1) * gradient[i];
+            v[i] = beta2 * v[i] + (1 - beta2) * gradient[i] * gradient[i];
+            double mHat = m[i] / (1 - std::pow(beta1, epoch));
+            double vHat = v[i] / (1 - std::pow(beta2, epoch));
+            weights[i] -= rate * mHat / (std::sqrt(vHat) + epsilon);
+        }
+        std::chrono::duration<double> epochTime = std::chrono::steady_clock::now() - epochStart;
+        std::cout << "Epoch " << epoch << " Error: " << std::setprecision(8) << error << " Time: "
+                  << std::setprecision(4) << epochTime.count() << "s" << std::endl;
+    }
+    std::cout << "Final error: " << std::setprecision(8) << tuningError(positions, weights, k, threads, nullptr)
+              << std::endl;
+    writeWeightsHeader(outputPath, weights);
+    std::cout << "Wrote " << outputPath << std::endl;
+    return 0;
+}
 
 /*
  * STD: Standard Minimax
@@ -1196,7 +5052,7 @@ void saveNegamaxResults(int depth, const std::string &fen) {
  * TT: Transposition Tables
  * ID: Iterative Deepening
  *
- * USE NegamaxResults.txt generated from SaveNegamaxResults() to determine Depth
+ * USE ./congo bench to determine Depth
  * MAX STD DEPTH CAN BE 4 else it takes way to0 long
  *
  *
@@ -1539,8 +5395,17 @@ void ID_TT_Vs_Ordered(char toPlayAs) {
 
 void API() {
     char gameOver = 'n';
-    Board *board = nullptr;
-    MiniMax MM = MiniMax();
+    Engine engine;
+    MiniMax &MM = engine.getMiniMax();
+    MM.setStatsOutput(&std::cerr);
+    OpeningBook book;
+    if (book.open("congo.book")) {
+        MM.setOpeningBook(&book);
+    }
+    Tablebases tablebases;
+    if (tablebases.load("tablebases") > 0) {
+        MM.setTablebases(&tablebases);
+    }
     while (gameOver == 'n') {
         std::string input, positions;
         getline(std::cin, input);
@@ -1549,33 +5414,254 @@ void API() {
             std::regex target("position ");
             std::string replacement;
             positions = std::regex_replace(positions, target, replacement);
-            board = new Board(positions);
+            engine.newGame(positions);
         } else if (input.find("go ") != std::string::npos) {
             std::regex target("go ");
             std::string replacement;
             input = std::regex_replace(input, target, replacement);
-            int time = std::stoi(input) - 3;
-            std::string fen = board->getFen();
-            std::string move = MM.iterativeDeepening(fen, 50, TRANSPOSITION_TABLES, time);
-            board->makeMove(move);
+            SearchLimits limits;
+            limits.seconds = std::stoi(input) - 3;
+            std::string move = engine.search(limits);
+            engine.applyMove(move);
             std::cout << move << std::endl;
         } else if (input.find("moves") != std::string::npos) {
             std::regex target("moves ");
             std::string replacement;
             std::string move = std::regex_replace(input, target, replacement);
-            board->makeMove(move);
+            engine.applyMove(move);
         } else if (input == "print") {
-            board->printBoard();
+            engine.getBoard().printBoard();
         }
-        gameOver = board->isGameOver();
+        gameOver = engine.isGameOver();
+    }
+
+
+}
+
+
+/*
+ * UCI style protocol on stdin/stdout. Searches run on their own thread so that stop, isready and the
+ * rest are answered while the engine thinks; bestmove is printed when the search finishes or is stopped.
+ *
+ *   uci | isready | ucinewgame | quit
+ *   position startpos|fen <fen> [moves m1 m2 ...]
+ *   go [depth n] [nodes n] [movetime ms] [infinite]
+ *   stop
+ *   setoption name Threads|Hash value n
+ *   setoption name EvalFile value <file>
+ *
+ * Every completed depth is reported as "info depth d score cp s nodes n nps n time ms hashfull n pv ...".
+ */
+int protocol() {
+    const std::string startFen = START_FEN;
+    Engine engine(startFen);
+    MiniMax &mm = engine.getMiniMax();
+    OpeningBook book;
+    if (book.open("congo.book")) {
+        mm.setOpeningBook(&book);
     }
+    Tablebases tablebases;
+    if (tablebases.load("tablebases") > 0) {
+        mm.setTablebases(&tablebases);
+    }
+    int threads = 1;
+    int hashMB = TT_DEFAULT_MB;
+    auto network = std::make_unique<NNUENetwork>();
+
+    std::mutex outputLock;
+    auto send = [&](const std::string &line) {
+        std::lock_guard<std::mutex> guard(outputLock);
+        std::cout << line << std::endl;
+    };
 
+    std::atomic<bool> stop(false);
+    std::mutex stopLock;
+    std::condition_variable stopped;
+    std::thread searcher;
+    mm.setStopFlag(&stop);
+    mm.setInfoCallback([&](int depth, const PVLine &line, unsigned long long nodes, double seconds) {
+        std::stringstream info;
+        info << "info depth " << depth << " score cp " << line.score << " nodes " << nodes << " nps "
+             << (unsigned long long) (nodes / std::max(seconds, 1e-6)) << " time " << (long long) (seconds * 1000)
+             << " hashfull " << mm.hashfull() << " pv";
+        for (const auto &m: line.pv) {
+            info << " " << m;
+        }
+        send(info.str());
+    });
+
+    auto stopSearch = [&]() {
+        if (searcher.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(stopLock);
+                stop = true;
+            }
+            stopped.notify_all();
+            searcher.join();
+        }
+    };
 
+    std::string input;
+    while (getline(std::cin, input)) {
+        std::stringstream tokens(input);
+        std::string command;
+        tokens >> command;
+        if (command == "uci") {
+            send("id name Congo");
+            send("option name Threads type spin default 1 min 1 max 256");
+            send("option name Hash type spin default " + std::to_string(TT_DEFAULT_MB) + " min 1 max 65536");
+            send("option name EvalFile type string default <empty>");
+            send("uciok");
+        } else if (command == "isready") {
+            send("readyok");
+        } else if (command == "ucinewgame" || command == "newgame") {
+            stopSearch();
+            engine.newGame(startFen, threads);
+        } else if (command == "position") {
+            stopSearch();
+            std::string kind, token, fen;
+            tokens >> kind;
+            if (kind == "fen") {
+                while (tokens >> token && token != "moves") {
+                    fen += (fen.empty() ? "" : " ") + token;
+                }
+            } else {
+                fen = startFen;
+                tokens >> token;
+            }
+            engine.setPosition(fen);
+            if (token == "moves") {
+                while (tokens >> token) {
+                    engine.applyMove(token);
+                }
+            }
+        } else if (command == "setoption") {
+            std::string token, name, value;
+            while (tokens >> token) {
+                if (token == "name") tokens >> name;
+                else if (token == "value") tokens >> value;
+            }
+            if (name == "Threads" && !value.empty()) threads = std::max(1, std::stoi(value));
+            else if (name == "Hash" && !value.empty()) {
+                stopSearch();
+                hashMB = std::max(1, std::stoi(value));
+                mm.setHashSize(hashMB, threads);
+            } else if (name == "EvalFile") {
+                stopSearch();
+                bool loaded = !value.empty() && value != "<empty>" && loadNetwork(value, *network);
+                mm.setNetwork(loaded ? network.get() : nullptr);
+                send(loaded ? "info string loaded " + value : "info string using the built in evaluation");
+            }
+        } else if (command == "go") {
+            stopSearch();
+            int depth = 50;
+            unsigned long long nodes = 0;
+            double seconds = 1e9;
+            bool infinite = false;
+            std::string token;
+            while (tokens >> token) {
+                if (token == "depth") tokens >> depth;
+                else if (token == "nodes") tokens >> nodes;
+                else if (token == "movetime") {
+                    double ms;
+                    tokens >> ms;
+                    seconds = ms / 1000;
+                } else if (token == "infinite") infinite = true;
+            }
+            stop = false;
+            SearchLimits limits;
+            limits.depth = depth;
+            limits.nodes = nodes;
+            limits.seconds = seconds;
+            searcher = std::thread([&, limits, infinite]() {
+                std::string move = mm.getBookMove(engine.getBoard());
+                if (move.empty()) {
+                    auto lines = engine.analyse(limits, 1);
+                    move = lines.empty() ? "" : lines.rbegin()->second.front().pv.front();
+                }
+                if (infinite) {
+                    std::unique_lock<std::mutex> guard(stopLock);
+                    stopped.wait(guard, [&]() { return stop.load(); });
+                }
+                send("bestmove " + (move.empty() ? std::string("0000") : move));
+            });
+        } else if (command == "stop") {
+            stopSearch();
+        } else if (command == "print") {
+            stopSearch();
+            engine.getBoard().printBoard();
+        } else if (command == "quit") {
+            break;
+        }
+    }
+    stopSearch();
+    return 0;
 }
 
+int main(int argc, char *argv[]) {
+    std::string startFen = START_FEN;
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    //congo buildbook [plies] [depth] [threads] [margin] [width] [file]
+    if (!args.empty() && args[0] == "buildbook") {
+        int plies = args.size() > 1 ? std::stoi(args[1]) : 8;
+        int bookDepth = args.size() > 2 ? std::stoi(args[2]) : 4;
+        int threads = args.size() > 3 ? std::stoi(args[3]) : (int) std::max(1u, std::thread::hardware_concurrency());
+        int margin = args.size() > 4 ? std::stoi(args[4]) : 20;
+        int width = args.size() > 5 ? std::stoi(args[5]) : 2;
+        std::string path = args.size() > 6 ? args[6] : "congo.book";
+        buildOpeningBook(startFen, plies, bookDepth, threads, margin, width, path);
+        return 0;
+    }
+
+    if (!args.empty() && args[0] == "bench") {
+        return bench(args);
+    }
+
+    if (!args.empty() && args[0] == "microbench") {
+        return microbench(args);
+    }
+
+    if (!args.empty() && args[0] == "tournament") {
+        return tournament(args);
+    }
+
+    if (!args.empty() && args[0] == "analyse") {
+        return analyse(args);
+    }
+
+    if (!args.empty() && args[0] == "trace") {
+        return trace(args);
+    }
+
+    if (!args.empty() && args[0] == "uci") {
+        return protocol();
+    }
+
+    if (!args.empty() && args[0] == "tune") {
+        return tune(args);
+    }
+
+    if (!args.empty() && args[0] == "selfplay") {
+        return selfplay(args);
+    }
+
+    if (!args.empty() && args[0] == "gamedb") {
+        return gamedb(args);
+    }
+
+    //congo tbgen [threads] [directory] [signatures...]
+    if (!args.empty() && args[0] == "tbgen") {
+        int threads = args.size() > 1 ? std::stoi(args[1]) : (int) std::max(1u, std::thread::hardware_concurrency());
+        std::string directory = args.size() > 2 ? args[2] : "tablebases";
+        std::vector<std::string> signatures(args.begin() + std::min<size_t>(args.size(), 3), args.end());
+        if (signatures.empty()) {
+            signatures = {"LPvl", "LEvl", "LZvl", "Lvlp", "Lvle", "Lvlz"};
+        }
+        generateTablebases(signatures, directory, threads);
+        return 0;
+    }
 
-int main() {
-    std::string startFen = "2ele1z/ppppppp/7/7/7/PPPPPPP/2ELE1Z w 0";
     int depth = 3;
     int myMode = ALPHA_BETA;
     int myTime = ID_TIME;
@@ -1586,5 +5672,10 @@ int main() {
     int oppTime = ID_TIME;
     bool oppID = false;
 
-    playBoardNegamaxGame(startFen, depth, myMode, 'w', oppMode, oppDepth, myID, oppID, myTime, oppTime);
+    OpeningBook book;
+    book.open("congo.book");
+    Tablebases tablebases;
+    tablebases.load("tablebases");
+    playBoardNegamaxGame(startFen, depth, myMode, 'w', oppMode, oppDepth, myID, oppID, myTime, oppTime, &book,
+                         &tablebases);
 }
\ No newline at end of file
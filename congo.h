@@ -5,6 +5,9 @@
 #include <chrono>
 #include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
 #include <array>
 #include <utility>
 #include <vector>
@@ -12,6 +15,27 @@
 #include <iterator>
 #include <unordered_map>
 #include <set>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #ifndef CONGO_CONGO_H
 #define CONGO_CONGO_H
@@ -23,6 +47,69 @@
 #define ORDERED 4
 #define ITERATIVE_DEEPENING 5
 
+#define ZOBRIST_SEED 0x436F6E676F5A6F62ULL
+#define BENCH_SEED 20220101
+#define BOOK_MAGIC "CGBK"
+#define BOOK_VERSION 2
+#define TB_MAGIC "CGTB"
+#define TB_VERSION 1
+#define TB_BLOCK_SIZE 4096
+#define TB_MAX_PIECES 4
+#define MAX_LION_EXTENSIONS 4
+#define TT_DEFAULT_MB 16
+#define TUNE_MAX_PIECES 32
+#define NNUE_MAGIC "CGNN"
+#define NNUE_VERSION 2
+#define NNUE_INPUTS 588
+#define NNUE_HIDDEN 32
+#define NNUE_QA 127
+#define NNUE_QB 64
+#define NNUE_OUTPUT_SCALE 400
+#define FRONTIER_MAX_CHILDREN 128
+#define FRONTIER_CHANGES 9
+#define QUIESCENCE_MAX_PLY 8
+#define REPETITION_FILTER_SIZE 1024
+#define SELFPLAY_MAGIC "CGSP"
+#define SELFPLAY_VERSION 1
+#define GAMEDB_MAGIC "CGDB"
+#define GAMEDB_VERSION 1
+#define START_FEN "1melecz/ppppppp/7/7/7/PPPPPPP/1MELECZ w 0"
+#define GEN_CAPTURES 1
+#define GEN_QUIETS 2
+#define GEN_ALL 3
+#define MAX_KILLER_PLY 64
+#define TRACE_MAGIC "CGTR"
+#define TRACE_VERSION 1
+#define TRACE_RING_EVENTS 4096
+#define PERF_COUNTERS 4
+#define PERF_MAX_NESTING 16
+
+//Search counters compile away with -DCONGO_NO_STATS
+#ifdef CONGO_NO_STATS
+#define STAT_INC(counter)
+#define STAT_CUTOFF(first)
+#else
+#define STAT_INC(counter) (stats.counter++)
+#define STAT_CUTOFF(first) (stats.betaCutoffs++, stats.firstMoveCutoffs += (first) ? 1 : 0)
+#endif
+
+//Search tracing compiles in with -DCONGO_TRACE and records once MiniMax::setTracer is given a SearchTracer
+#ifdef CONGO_TRACE
+#define TRACE_EVENT(...) (traceSampled ? traceEvent(__VA_ARGS__) : (void) 0)
+#define TRACE_MOVE(move) (tracer != nullptr ? (void) (traceMove = encodeMove(move)) : (void) 0)
+#else
+#define TRACE_EVENT(...)
+#define TRACE_MOVE(move)
+#endif
+
+//Search phase profiling compiles in with -DCONGO_PERF (or -DCONGO_TRACK_ALLOCS for allocations only) and counts
+//while a MiniMax has a PhaseProfiler
+#if defined(CONGO_PERF) || defined(CONGO_TRACK_ALLOCS)
+#define PHASE_SCOPE(phase) PhaseScope phaseScope(phase)
+#else
+#define PHASE_SCOPE(phase)
+#endif
+
 template<typename Iter, typename RandomGenerator>
 Iter select_randomly(Iter start, Iter end, RandomGenerator &g) {
     std::uniform_int_distribution<> dis(0, std::distance(start, end) - 1);
@@ -30,11 +117,19 @@ Iter select_randomly(Iter start, Iter end, RandomGenerator &g) {
     return start;
 }
 
+std::mt19937 &getRandomGenerator() {
+    static std::mt19937 gen((std::random_device()) ());
+    return gen;
+}
+
+//Makes RANDOM play and select_randomly reproducible
+void seedRandom(unsigned int seed) {
+    getRandomGenerator().seed(seed);
+}
+
 template<typename Iter>
 Iter select_randomly(Iter start, Iter end) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    return select_randomly(start, end, gen);
+    return select_randomly(start, end, getRandomGenerator());
 }
 
 std::chrono::duration<double> seconds_to_duration(double seconds) {
@@ -420,6 +515,321 @@ std::vector<std::string> PawnMoves(std::array<char, 49> board, char toPlay) {
     return LegalMoves;
 }
 
+//Square index of the coordinate at c, e.g. "a7" -> 0, without the checks of getIndexFromCoord
+int getSquareFromChars(const char *c) {
+    return (7 - (c[1] - '0')) * 7 + (c[0] - 'a');
+}
+
+void writeCoord(char *out, int square) {
+    out[0] = (char) ('a' + square % 7);
+    out[1] = (char) ('7' - square / 7);
+}
+
+/*
+ * Neighbour squares for the monkey and crocodile, -1 past the edge of the board or the end of a list. step and
+ * jump are the adjacent square and the one beyond it in each direction, direction 7 - d being opposite to d.
+ * A crocodile steps like a king and also slides down its file to the river, or along the river when in it:
+ * crocodileRays lists those slides nearest square first and crocodileSteps the king steps they do not cover.
+ * The other lists are the target squares of generateSquareMoves, pawn lists by colour (0 white, 1 black), and
+ * pawnRetreats only past the river, nearest square first.
+ */
+struct MoveTables {
+    signed char step[49][8];
+    signed char jump[49][8];
+    signed char crocodileSteps[49][9];
+    signed char crocodileRays[49][2][7];
+    signed char lion[49][9];
+    signed char zebra[49][9];
+    signed char elephant[49][9];
+    signed char pawnSteps[2][49][4];
+    signed char pawnRetreats[2][49][3];
+};
+
+MoveTables buildMoveTables() {
+    MoveTables tables{};
+    const int rows[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    const int cols[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    auto onBoard = [](int row, int col) { return row >= 0 && row < 7 && col >= 0 && col < 7; };
+    const int zebraRows[8] = {-2, -2, -1, -1, 1, 1, 2, 2};
+    const int zebraCols[8] = {-1, 1, -2, 2, -2, 2, -1, 1};
+    const int elephantRows[8] = {-2, -1, 0, 0, 0, 0, 1, 2};
+    const int elephantCols[8] = {0, 0, -2, -1, 1, 2, 0, 0};
+    auto inCastle = [](int row, int col) { return row != 3 && col >= 2 && col <= 4; };
+    std::memset(&tables, -1, sizeof(tables));
+
+    for (int s = 0; s < 49; ++s) {
+        int row = s / 7;
+        int col = s % 7;
+        //Directions of the crocodile's slides: down or up the file towards the river, or both ways along it
+        int rays[2] = {row < 3 ? 6 : row > 3 ? 1 : 3, row == 3 ? 4 : -1};
+        int steps = 0;
+        for (int d = 0; d < 8; ++d) {
+            bool near = onBoard(row + rows[d], col + cols[d]);
+            bool far = onBoard(row + 2 * rows[d], col + 2 * cols[d]);
+            tables.step[s][d] = (signed char) (near ? (row + rows[d]) * 7 + col + cols[d] : -1);
+            tables.jump[s][d] = (signed char) (far ? (row + 2 * rows[d]) * 7 + col + 2 * cols[d] : -1);
+            if (near && d != rays[0] && d != rays[1]) {
+                tables.crocodileSteps[s][steps++] = tables.step[s][d];
+            }
+        }
+        int lion = 0, zebra = 0, elephant = 0;
+        for (int d = 0; d < 8; ++d) {
+            if (inCastle(row, col) && onBoard(row + rows[d], col + cols[d]) && inCastle(row + rows[d], col + cols[d])) {
+                tables.lion[s][lion++] = tables.step[s][d];
+            }
+            if (onBoard(row + zebraRows[d], col + zebraCols[d])) {
+                tables.zebra[s][zebra++] = (signed char) ((row + zebraRows[d]) * 7 + col + zebraCols[d]);
+            }
+            if (onBoard(row + elephantRows[d], col + elephantCols[d])) {
+                tables.elephant[s][elephant++] = (signed char) ((row + elephantRows[d]) * 7 + col + elephantCols[d]);
+            }
+        }
+        for (int colour = 0; colour < 2; ++colour) {
+            int forward = colour == 0 ? -1 : 1;
+            int pawn = 0;
+            for (int c = col - 1; c <= col + 1; ++c) {
+                if (onBoard(row + forward, c)) {
+                    tables.pawnSteps[colour][s][pawn++] = (signed char) ((row + forward) * 7 + c);
+                }
+            }
+            if (colour == 0 ? row < 3 : row > 3) {
+                for (int i = 1, retreat = 0; i <= 2 && onBoard(row - i * forward, col); ++i) {
+                    tables.pawnRetreats[colour][s][retreat++] = (signed char) ((row - i * forward) * 7 + col);
+                }
+            }
+        }
+        for (int r = 0; r < 2; ++r) {
+            if (rays[r] < 0) {
+                continue;
+            }
+            int length = 0;
+            for (int i = 1; onBoard(row + i * rows[rays[r]], col + i * cols[rays[r]]); ++i) {
+                int to = (row + i * rows[rays[r]]) * 7 + col + i * cols[rays[r]];
+                tables.crocodileRays[s][r][length++] = (signed char) to;
+                if (to / 7 == 3 && row != 3) {
+                    break;
+                }
+            }
+        }
+    }
+    return tables;
+}
+
+const MoveTables &getMoveTables() {
+    static const MoveTables tables = buildMoveTables();
+    return tables;
+}
+
+//Bit s set for each square s holding piece
+unsigned long long getPieceSquares(const std::array<char, 49> &board, char piece) {
+    unsigned long long squares = 0;
+    for (int s = 0; s < 49; ++s) {
+        squares |= (unsigned long long) (board[s] == piece) << s;
+    }
+    return squares;
+}
+
+//Appends the moves from s to each listed square without a piece of toPlay, quiet or captures as kinds asks
+void addTargetMoves(const std::array<char, 49> &board, char toPlay, int s, const signed char *targets, int kinds,
+                    std::vector<std::string> &moves) {
+    char text[4];
+    writeCoord(text, s);
+    for (int i = 0; targets[i] >= 0; ++i) {
+        char tile = board[targets[i]];
+        if (getPieceColour(tile) != toPlay && (kinds & (tile == '_' ? GEN_QUIETS : GEN_CAPTURES))) {
+            writeCoord(text + 2, targets[i]);
+            moves.emplace_back(text, 4);
+        }
+    }
+}
+
+//Moves of the crocodile on s; a crocodile never drowns, so it may stay in the river
+void CrocodileHelper(const std::array<char, 49> &board, int s, char toPlay, int kinds,
+                     std::vector<std::string> &moves) {
+    const MoveTables &tables = getMoveTables();
+    char text[4];
+    writeCoord(text, s);
+    addTargetMoves(board, toPlay, s, tables.crocodileSteps[s], kinds, moves);
+    for (const auto &ray: tables.crocodileRays[s]) {
+        for (int i = 0; ray[i] >= 0 && getPieceColour(board[ray[i]]) != toPlay; ++i) {
+            if (kinds & (board[ray[i]] == '_' ? GEN_QUIETS : GEN_CAPTURES)) {
+                writeCoord(text + 2, ray[i]);
+                moves.emplace_back(text, 4);
+            }
+            if (board[ray[i]] != '_') {
+                break;
+            }
+        }
+    }
+}
+
+//Crocodile moves appended to moves
+void CrocodileMoves(const std::array<char, 49> &board, char toPlay, std::vector<std::string> &moves) {
+    for (auto squares = getPieceSquares(board, setPieceCase(toPlay, 'c')); squares; squares &= squares - 1) {
+        CrocodileHelper(board, __builtin_ctzll(squares), toPlay, GEN_ALL, moves);
+    }
+}
+
+/*
+ * Moves of the monkey on s: king steps to empty squares (quiet), and jumps over an adjacent enemy piece to the
+ * empty square behind it, chained for as long as the monkey likes (captures). Every chain is written as its start
+ * and landing squares ("c3e5c7"). Jumped pieces stay on the board until the move ends and can not be jumped again,
+ * and taking the lion ends the chain. The chains are walked depth first with a stack of landing squares, next
+ * directions and jumped square sets instead of recursion.
+ */
+void MonkeyHelper(const std::array<char, 49> &board, int s, char toPlay, int kinds, std::vector<std::string> &moves) {
+    const MoveTables &tables = getMoveTables();
+    char opponent = flipColour(toPlay);
+    //Each jump takes a different piece, so a chain has at most 48 of them
+    int landing[49];
+    int direction[49];
+    unsigned long long jumped[49];
+    char text[100];
+    writeCoord(text, s);
+    if (kinds & GEN_QUIETS) {
+        for (int d = 0; d < 8; ++d) {
+            int to = tables.step[s][d];
+            if (to >= 0 && board[to] == '_') {
+                writeCoord(text + 2, to);
+                moves.emplace_back(text, 4);
+            }
+        }
+    }
+    if (!(kinds & GEN_CAPTURES)) {
+        return;
+    }
+
+    int k = 0;
+    landing[0] = s;
+    direction[0] = 0;
+    jumped[0] = 0;
+    while (k >= 0) {
+        if (direction[k] == 8) {
+            k--;
+            continue;
+        }
+        int d = direction[k]++;
+        int over = tables.step[landing[k]][d];
+        int to = tables.jump[landing[k]][d];
+        if (to < 0 || getPieceColour(board[over]) != opponent || (jumped[k] >> over & 1) ||
+            (board[to] != '_' && to != s)) {
+            continue;
+        }
+        k++;
+        landing[k] = to;
+        direction[k] = toupper(board[over]) == 'L' ? 8 : 0;
+        jumped[k] = jumped[k - 1] | 1ULL << over;
+        writeCoord(text + 2 * k, to);
+        moves.emplace_back(text, 2 * (k + 1));
+    }
+}
+
+//Monkey moves appended to moves
+void MonkeyMoves(const std::array<char, 49> &board, char toPlay, std::vector<std::string> &moves) {
+    for (auto squares = getPieceSquares(board, setPieceCase(toPlay, 'm')); squares; squares &= squares - 1) {
+        MonkeyHelper(board, __builtin_ctzll(squares), toPlay, GEN_ALL, moves);
+    }
+}
+
+/*
+ * Appends the moves of toPlay's piece on s that GenerateAllLegalMoves makes, the captures (GEN_CAPTURES), the
+ * quiet moves (GEN_QUIETS) or both. A capture is a move with a getMoveTarget piece, including the lion taking the
+ * facing lion along a clear file or across an empty d4.
+ */
+void generateSquareMoves(const std::array<char, 49> &board, char toPlay, int s, int kinds,
+                         std::vector<std::string> &moves) {
+    const MoveTables &tables = getMoveTables();
+    int colour = toPlay == 'w' ? 0 : 1;
+    switch (toupper(board[s])) {
+        case 'L': {
+            addTargetMoves(board, toPlay, s, tables.lion[s], kinds, moves);
+            int opponent = getSinglePiecePos(board, setPieceCase(flipColour(toPlay), 'l'));
+            if (!(kinds & GEN_CAPTURES) || opponent < 0) {
+                break;
+            }
+            bool facing = false;
+            if (opponent % 7 == s % 7) {
+                int step = opponent > s ? 7 : -7;
+                int it = s + step;
+                while (it != opponent && board[it] == '_') {
+                    it += step;
+                }
+                facing = it == opponent;
+            } else {
+                int diag = s - opponent;
+                facing = (diag == 12 || diag == 16 || diag == -12 || diag == -16) && board[24] == '_';
+            }
+            if (facing) {
+                char text[4];
+                writeCoord(text, s);
+                writeCoord(text + 2, opponent);
+                moves.emplace_back(text, 4);
+            }
+            break;
+        }
+        case 'Z':
+            addTargetMoves(board, toPlay, s, tables.zebra[s], kinds, moves);
+            break;
+        case 'E':
+            addTargetMoves(board, toPlay, s, tables.elephant[s], kinds, moves);
+            break;
+        case 'P':
+            addTargetMoves(board, toPlay, s, tables.pawnSteps[colour][s], kinds, moves);
+            if (kinds & GEN_QUIETS) {
+                char text[4];
+                writeCoord(text, s);
+                for (int i = 0; tables.pawnRetreats[colour][s][i] >= 0; ++i) {
+                    int to = tables.pawnRetreats[colour][s][i];
+                    if (board[to] != '_') {
+                        break;
+                    }
+                    writeCoord(text + 2, to);
+                    moves.emplace_back(text, 4);
+                }
+            }
+            break;
+        case 'M':
+            MonkeyHelper(board, s, toPlay, kinds, moves);
+            break;
+        case 'C':
+            CrocodileHelper(board, s, toPlay, kinds, moves);
+            break;
+    }
+}
+
+//Moves of every piece of toPlay, square by square
+void generateMoves(const std::array<char, 49> &board, char toPlay, int kinds, std::vector<std::string> &moves) {
+    for (int s = 0; s < 49; ++s) {
+        if (getPieceColour(board[s]) == toPlay) {
+            generateSquareMoves(board, toPlay, s, kinds, moves);
+        }
+    }
+}
+
+//Calls fn with every square a monkey's move jumps over, the middle of each hop two squares long
+template<typename F>
+void forEachJumpedSquare(const std::string &move, F fn) {
+    for (size_t i = 2; i + 1 < move.size(); i += 2) {
+        int from = getSquareFromChars(move.data() + i - 2);
+        int to = getSquareFromChars(move.data() + i);
+        if (std::abs(from / 7 - to / 7) == 2 || std::abs(from % 7 - to % 7) == 2) {
+            fn((from + to) / 2);
+        }
+    }
+}
+
+//The piece a move takes last: the one on its destination, or the one a monkey's final jump passes over
+char getMoveTarget(const std::array<char, 49> &b, const std::string &move) {
+    size_t n = move.size();
+    int to = getSquareFromChars(move.data() + n - 2);
+    if (toupper(b[getSquareFromChars(move.data())]) == 'M') {
+        int from = getSquareFromChars(move.data() + n - 4);
+        bool jump = std::abs(from / 7 - to / 7) == 2 || std::abs(from % 7 - to % 7) == 2;
+        return jump ? b[(from + to) / 2] : '_';
+    }
+    return b[to];
+}
+
 void DumpVectorContents(std::vector<std::string> &into, std::vector<std::string> toDump) {
     into.insert(into.end(), toDump.begin(), toDump.end());
 }
@@ -435,6 +845,664 @@ int getTurnNumber(std::string fen) {
             fen.end());
     return std::stoi(fen);
 }
+template<typename F>
+void parallelFor(size_t count, size_t chunk, int threads, F fn) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk)) {
+            fn(begin, std::min(count, begin + chunk));
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &t: pool) {
+        t.join();
+    }
+}
+
+const std::array<int, 9> WhiteCastle = {30, 31, 32, 37, 38, 39, 44, 45, 46};
+const std::array<int, 9> BlackCastle = {2, 3, 4, 9, 10, 11, 16, 17, 18};
+
+int getCastleIndex(int square, char colour) {
+    const auto &castle = colour == 'w' ? WhiteCastle : BlackCastle;
+    auto it = std::find(castle.begin(), castle.end(), square);
+    if (it == castle.end()) {
+        return -1;
+    }
+    return (int) (it - castle.begin());
+}
+
+//Material signature of a position, e.g. "LPvl": lion and sorted white pieces, 'v', lion and sorted black pieces
+std::string getMaterialSignature(const std::array<char, 49> &b) {
+    std::string white, black;
+    for (auto i: b) {
+        if (isupper(i) && i != 'L') {
+            white += i;
+        } else if (islower(i) && i != 'l') {
+            black += i;
+        }
+    }
+    std::sort(white.begin(), white.end());
+    std::sort(black.begin(), black.end());
+    return "L" + white + "vl" + black;
+}
+
+//Pieces of a signature other than the two lions, in index order
+std::string getSignatureExtras(const std::string &signature) {
+    std::string extras;
+    for (auto i: signature) {
+        if (i != 'L' && i != 'l' && i != 'v') {
+            extras += i;
+        }
+    }
+    return extras;
+}
+
+long long getTablebaseSize(const std::string &signature) {
+    long long size = 2 * 9 * 9;
+    for (size_t i = 0; i < getSignatureExtras(signature).size(); ++i) {
+        size *= 49;
+    }
+    return size;
+}
+
+/*
+ * Index layout: white lion castle square, black lion castle square, one board square per extra piece,
+ * side to move. Identical pieces take their squares in ascending order. Returns -1 if the position does
+ * not fit the signature.
+ */
+long long getTablebaseIndex(const std::array<char, 49> &b, char toPlay, const std::string &signature) {
+    int whiteLion = getCastleIndex(getSinglePiecePos(b, 'L'), 'w');
+    int blackLion = getCastleIndex(getSinglePiecePos(b, 'l'), 'b');
+    if (whiteLion < 0 || blackLion < 0) {
+        return -1;
+    }
+    long long index = whiteLion * 9 + blackLion;
+    std::string extras = getSignatureExtras(signature);
+    for (size_t i = 0; i < extras.size();) {
+        auto squares = getMultiplePiecePos(b, extras[i]);
+        for (auto sq: squares) {
+            if (i >= extras.size() || extras[i] != b[sq]) {
+                return -1;
+            }
+            index = index * 49 + sq;
+            i++;
+        }
+        if (squares.empty()) {
+            return -1;
+        }
+    }
+    return index * 2 + (toPlay == 'b' ? 1 : 0);
+}
+
+//Inverse of getTablebaseIndex; false for indices that do not describe a legal placement
+bool getTablebasePosition(long long index, const std::string &signature, std::array<char, 49> &b, char &toPlay) {
+    std::string extras = getSignatureExtras(signature);
+    std::vector<int> squares(extras.size());
+    b.fill('_');
+    toPlay = index % 2 ? 'b' : 'w';
+    index /= 2;
+    for (int i = (int) extras.size() - 1; i >= 0; --i) {
+        squares[i] = (int) (index % 49);
+        index /= 49;
+    }
+    b[BlackCastle[index % 9]] = 'l';
+    b[WhiteCastle[index / 9]] = 'L';
+    for (size_t i = 0; i < extras.size(); ++i) {
+        if (b[squares[i]] != '_') {
+            return false;
+        }
+        if (i > 0 && extras[i] == extras[i - 1] && squares[i] < squares[i - 1]) {
+            return false;
+        }
+        b[squares[i]] = extras[i];
+    }
+    return true;
+}
+
+/*
+ * Reverse attack tables: bit s of table[t] is set when a piece of that kind standing on s could capture on t.
+ * Zebra and elephant moves are symmetric; pawns are split by colour since they only capture forwards.
+ */
+struct AttackTables {
+    std::array<unsigned long long, 49> zebra{};
+    std::array<unsigned long long, 49> elephant{};
+    std::array<unsigned long long, 49> whitePawn{};
+    std::array<unsigned long long, 49> blackPawn{};
+};
+
+AttackTables buildAttackTables() {
+    AttackTables tables;
+    const int zebraRows[8] = {1, 2, 2, 1, -1, -2, -2, -1};
+    const int zebraCols[8] = {2, 1, -1, -2, -2, -1, 1, 2};
+    const int elephantRows[8] = {1, -1, 2, -2, 0, 0, 0, 0};
+    const int elephantCols[8] = {0, 0, 0, 0, 1, -1, -2, 2};
+    auto onBoard = [](int row, int col) { return row >= 0 && row < 7 && col >= 0 && col < 7; };
+
+    for (int s = 0; s < 49; ++s) {
+        int row = s / 7;
+        int col = s % 7;
+        for (int i = 0; i < 8; ++i) {
+            if (onBoard(row + zebraRows[i], col + zebraCols[i])) {
+                tables.zebra[(row + zebraRows[i]) * 7 + col + zebraCols[i]] |= 1ULL << s;
+            }
+            if (onBoard(row + elephantRows[i], col + elephantCols[i])) {
+                tables.elephant[(row + elephantRows[i]) * 7 + col + elephantCols[i]] |= 1ULL << s;
+            }
+        }
+        for (int c = col - 1; c <= col + 1; ++c) {
+            //White pawns move towards row 0 of the array
+            if (onBoard(row - 1, c)) {
+                tables.whitePawn[(row - 1) * 7 + c] |= 1ULL << s;
+            }
+            if (onBoard(row + 1, c)) {
+                tables.blackPawn[(row + 1) * 7 + c] |= 1ULL << s;
+            }
+        }
+    }
+    return tables;
+}
+
+const AttackTables &getAttackTables() {
+    static const AttackTables tables = buildAttackTables();
+    return tables;
+}
+
+//Squares of colour's crocodiles and monkeys that could take on target, a monkey by a single jump over it
+unsigned long long getMonkeyCrocodileAttackers(const std::array<char, 49> &b, int target, char colour) {
+    const MoveTables &tables = getMoveTables();
+    char crocodile = setPieceCase(colour, 'c');
+    char monkey = setPieceCase(colour, 'm');
+    unsigned long long attackers = 0;
+    for (int d = 0; d < 8; ++d) {
+        int s = tables.step[target][d];
+        int behind = tables.step[target][7 - d];
+        if (s >= 0 && (b[s] == crocodile || (b[s] == monkey && behind >= 0 && b[behind] == '_'))) {
+            attackers |= 1ULL << s;
+        }
+    }
+    //Crocodile slides, walked back from the target: down the file to the river, up it, and along the river
+    auto slide = [&](int d) {
+        for (int s = tables.step[target][d]; s >= 0; s = tables.step[s][d]) {
+            if (b[s] != '_') {
+                attackers |= b[s] == crocodile ? 1ULL << s : 0;
+                return;
+            }
+        }
+    };
+    int row = target / 7;
+    if (row <= 3) {
+        slide(1);
+    }
+    if (row >= 3) {
+        slide(6);
+    }
+    if (row == 3) {
+        slide(3);
+        slide(4);
+    }
+    return attackers;
+}
+
+//Squares of colour's pieces that can capture the opposing lion right now, including the facing lions rule
+unsigned long long getLionAttackers(const std::array<char, 49> &b, char colour) {
+    const AttackTables &tables = getAttackTables();
+    int target = getSinglePiecePos(b, setPieceCase(flipColour(colour), 'l'));
+    if (target < 0) {
+        return 0;
+    }
+
+    unsigned long long attackers = 0;
+    auto addAttackers = [&](unsigned long long candidates, char piece) {
+        while (candidates) {
+            int sq = __builtin_ctzll(candidates);
+            candidates &= candidates - 1;
+            if (b[sq] == piece) {
+                attackers |= 1ULL << sq;
+            }
+        }
+    };
+    addAttackers(tables.zebra[target], setPieceCase(colour, 'z'));
+    addAttackers(tables.elephant[target], setPieceCase(colour, 'e'));
+    addAttackers(colour == 'w' ? tables.whitePawn[target] : tables.blackPawn[target], setPieceCase(colour, 'p'));
+    attackers |= getMonkeyCrocodileAttackers(b, target, colour);
+
+    int lion = getSinglePiecePos(b, setPieceCase(colour, 'l'));
+    if (lion >= 0) {
+        if (lion % 7 == target % 7) {
+            bool freeCol = true;
+            for (int it = std::min(lion, target) + 7; it < std::max(lion, target); it += 7) {
+                if (b[it] != '_') {
+                    freeCol = false;
+                    break;
+                }
+            }
+            if (freeCol) {
+                attackers |= 1ULL << lion;
+            }
+        }
+        int diag = lion - target;
+        if ((diag == 12 || diag == 16 || diag == -12 || diag == -16) && b[24] == '_') {
+            attackers |= 1ULL << lion;
+        }
+    }
+    return attackers;
+}
+
+//Squares of colour's pieces that could capture on target, a non-lion square (lions only capture inside their castle)
+unsigned long long getSquareAttackers(const std::array<char, 49> &b, int target, char colour) {
+    const AttackTables &tables = getAttackTables();
+    unsigned long long attackers = 0;
+    auto addAttackers = [&](unsigned long long candidates, char piece) {
+        while (candidates) {
+            int sq = __builtin_ctzll(candidates);
+            candidates &= candidates - 1;
+            if (b[sq] == piece) {
+                attackers |= 1ULL << sq;
+            }
+        }
+    };
+    addAttackers(tables.zebra[target], setPieceCase(colour, 'z'));
+    addAttackers(tables.elephant[target], setPieceCase(colour, 'e'));
+    addAttackers(colour == 'w' ? tables.whitePawn[target] : tables.blackPawn[target], setPieceCase(colour, 'p'));
+    attackers |= getMonkeyCrocodileAttackers(b, target, colour);
+    int lion = getSinglePiecePos(b, setPieceCase(colour, 'l'));
+    if (lion >= 0 && getCastleIndex(target, colour) >= 0 && std::abs(lion / 7 - target / 7) <= 1 &&
+        std::abs(lion % 7 - target % 7) <= 1) {
+        attackers |= 1ULL << lion;
+    }
+    return attackers;
+}
+
+/*
+ * Building with -DCONGO_TRACK_ALLOCS replaces every global operator new and delete (plain, array, aligned and
+ * nothrow) to count allocations and their bytes per thread. Without it the counts are always 0.
+ */
+#ifdef CONGO_TRACK_ALLOCS
+thread_local unsigned long long allocationCount = 0;
+thread_local unsigned long long allocatedBytes = 0;
+
+//Out of line so the compiler does not pair the malloc and free under the operators with their callers' new/delete
+__attribute__((noinline)) void *trackedAllocation(std::size_t size, std::size_t alignment) noexcept {
+    allocationCount++;
+    allocatedBytes += size;
+    size = size == 0 ? 1 : size;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+__attribute__((noinline)) void trackedFree(void *p) noexcept {
+    std::free(p);
+}
+
+void *trackedNew(std::size_t size, std::size_t alignment) {
+    void *p = trackedAllocation(size, alignment);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(std::size_t size) {
+    return trackedNew(size, 0);
+}
+
+void *operator new[](std::size_t size) {
+    return trackedNew(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return trackedNew(size, (std::size_t) alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return trackedNew(size, (std::size_t) alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return trackedAllocation(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return trackedAllocation(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return trackedAllocation(size, (std::size_t) alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return trackedAllocation(size, (std::size_t) alignment);
+}
+
+void operator delete(void *p) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p) noexcept {
+    trackedFree(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+    trackedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    trackedFree(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    trackedFree(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    trackedFree(p);
+}
+
+unsigned long long getAllocationCount() {
+    return allocationCount;
+}
+
+unsigned long long getAllocatedBytes() {
+    return allocatedBytes;
+}
+
+bool allocationTracking() {
+    return true;
+}
+#else
+
+unsigned long long getAllocationCount() {
+    return 0;
+}
+
+unsigned long long getAllocatedBytes() {
+    return 0;
+}
+
+bool allocationTracking() {
+    return false;
+}
+
+#endif
+
+struct SearchStats {
+    unsigned long long nodes = 0;
+    unsigned long long evaluations = 0;
+    unsigned long long ttProbes = 0;
+    unsigned long long ttHits = 0;
+    unsigned long long ttCutoffs = 0;
+    unsigned long long betaCutoffs = 0;
+    unsigned long long firstMoveCutoffs = 0;
+    //Allocations of the thread, filled in by MiniMax::statsSnapshot
+    unsigned long long allocations = 0;
+    unsigned long long allocatedBytes = 0;
+
+    SearchStats &operator+=(const SearchStats &s) {
+        nodes += s.nodes;
+        evaluations += s.evaluations;
+        ttProbes += s.ttProbes;
+        ttHits += s.ttHits;
+        ttCutoffs += s.ttCutoffs;
+        betaCutoffs += s.betaCutoffs;
+        firstMoveCutoffs += s.firstMoveCutoffs;
+        allocations += s.allocations;
+        allocatedBytes += s.allocatedBytes;
+        return *this;
+    }
+
+    SearchStats operator-(const SearchStats &s) const {
+        SearchStats d = *this;
+        d.nodes -= s.nodes;
+        d.evaluations -= s.evaluations;
+        d.ttProbes -= s.ttProbes;
+        d.ttHits -= s.ttHits;
+        d.ttCutoffs -= s.ttCutoffs;
+        d.betaCutoffs -= s.betaCutoffs;
+        d.firstMoveCutoffs -= s.firstMoveCutoffs;
+        d.allocations -= s.allocations;
+        d.allocatedBytes -= s.allocatedBytes;
+        return d;
+    }
+
+    //One JSON line per iteration; ebf is nodes over the previous iteration's nodes
+    std::string toJson(const std::string &source, int depth, double seconds, const std::string &move, int score,
+                       unsigned long long previousNodes) const {
+        auto ratio = [](unsigned long long a, unsigned long long b) { return b == 0 ? 0.0 : (double) a / (double) b; };
+        std::ostringstream json;
+        json << "{\"source\":\"" << source << "\",\"depth\":" << depth << ",\"time\":" << seconds
+             << ",\"nodes\":" << nodes << ",\"nps\":" << (seconds > 0 ? (unsigned long long) (nodes / seconds) : 0)
+             << ",\"evaluations\":" << evaluations << ",\"ttProbes\":" << ttProbes
+             << ",\"ttHitRate\":" << ratio(ttHits, ttProbes) << ",\"ttCutoffRate\":" << ratio(ttCutoffs, ttProbes)
+             << ",\"betaCutoffs\":" << betaCutoffs
+             << ",\"firstMoveCutoffRate\":" << ratio(firstMoveCutoffs, betaCutoffs)
+             << ",\"ebf\":" << ratio(nodes, previousNodes) << ",\"move\":\"" << move << "\",\"score\":" << score;
+        if (allocationTracking()) {
+            json << ",\"allocations\":" << allocations << ",\"allocatedBytes\":" << allocatedBytes
+                 << ",\"allocationsPerNode\":" << ratio(allocations, nodes);
+        }
+        json << "}";
+        return json.str();
+    }
+};
+
+//Reads "key":number from a one-line JSON object
+double jsonNumber(const std::string &line, const std::string &key) {
+    size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    return std::stod(line.substr(pos + key.size() + 3));
+}
+
+std::string jsonString(const std::string &line, const std::string &key) {
+    size_t pos = line.find("\"" + key + "\":\"");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += key.size() + 4;
+    return line.substr(pos, line.find('"', pos) - pos);
+}
+
+//Packs a move into from/to square indices so it fits in a book entry
+unsigned short encodeMove(const std::string &move) {
+    int from = getIndexFromCoord(move.substr(0, 2));
+    int to = getIndexFromCoord(move.substr(move.size() - 2));
+    return (unsigned short) ((from << 8) | to);
+}
+
+std::string decodeMove(unsigned short move) {
+    return getCoordFromIndex(move >> 8) + getCoordFromIndex(move & 0xFF);
+}
+
+/*
+ * encodeMove keeps only the ends of a monkey's chain. Lossless form: the from square and first landing as
+ * encodeMove does, then one code per further landing square, bit 15 of a code set when another one follows.
+ * Plain moves are a single code equal to encodeMove's.
+ */
+void encodeMoveChain(const std::string &move, std::vector<unsigned short> &codes) {
+    codes.push_back((unsigned short) (getSquareFromChars(move.data()) << 8 | getSquareFromChars(move.data() + 2)));
+    for (size_t i = 4; i < move.size(); i += 2) {
+        codes.back() |= 0x8000;
+        codes.push_back((unsigned short) getSquareFromChars(move.data() + i));
+    }
+}
+
+//Reads one move from codes and moves codes past it
+std::string decodeMoveChain(const unsigned short *&codes) {
+    std::string move = decodeMove(*codes & 0x7FFF);
+    while (*codes++ & 0x8000) {
+        move += getCoordFromIndex(*codes & 0x7FFF);
+    }
+    return move;
+}
+
+/*
+ * Transposition table moves: the destination in bits 0-5, the origin in bits 6-11 and, for a monkey's chain of
+ * several jumps, its 1-based index in bits 12-15 among the chains of several jumps with the same ends in
+ * MonkeyHelper's order. Other moves and single jumps have 0 there (a monkey's step never has the ends of a jump).
+ * Past the 15th chain with the same ends there is no code, 0.
+ */
+unsigned short encodeTableMove(const std::array<char, 49> &board, char toPlay, const std::string &move) {
+    int from = getSquareFromChars(move.data());
+    int to = getSquareFromChars(move.data() + move.size() - 2);
+    auto code = (unsigned short) (from << 6 | to);
+    if (move.size() <= 4) {
+        return code;
+    }
+    std::vector<std::string> chains;
+    MonkeyHelper(board, from, toPlay, GEN_CAPTURES, chains);
+    int index = 0;
+    for (const auto &m: chains) {
+        if (m.size() > 4 && getSquareFromChars(m.data() + m.size() - 2) == to && ++index <= 15 && m == move) {
+            return (unsigned short) (code | index << 12);
+        }
+    }
+    return 0;
+}
+
+//The move of an encodeTableMove code on board, or "" when there is no such chain
+std::string decodeTableMove(const std::array<char, 49> &board, char toPlay, unsigned short code) {
+    int from = code >> 6 & 63;
+    int to = code & 63;
+    if (from >= 49 || to >= 49) {
+        return "";
+    }
+    if (code >> 12 == 0) {
+        return getCoordFromIndex(from) + getCoordFromIndex(to);
+    }
+    if (board[from] != setPieceCase(toPlay, 'm')) {
+        return "";
+    }
+    std::vector<std::string> chains;
+    MonkeyHelper(board, from, toPlay, GEN_CAPTURES, chains);
+    int index = 0;
+    for (const auto &m: chains) {
+        if (m.size() > 4 && getSquareFromChars(m.data() + m.size() - 2) == to && ++index == code >> 12) {
+            return m;
+        }
+    }
+    return "";
+}
+
+/*
+ * Dense piece numbers in "PEZLMCpezlmc" order, the order of the Zobrist keys, the NNUE inputs and the frontier
+ * features, with NoPiece for an empty square. Boards keep FEN chars; PieceIndex turns one into a table index.
+ */
+enum Piece : unsigned char {
+    WhitePawn, WhiteElephant, WhiteZebra, WhiteLion, WhiteMonkey, WhiteCrocodile,
+    BlackPawn, BlackElephant, BlackZebra, BlackLion, BlackMonkey, BlackCrocodile, NoPiece
+};
+
+const int PieceCount = 12;
+
+constexpr char PieceChars[] = "PEZLMCpezlmc_";
+
+constexpr std::array<unsigned char, 256> makePieceIndex() {
+    std::array<unsigned char, 256> index{};
+    for (auto &i: index) {
+        i = NoPiece;
+    }
+    for (int p = 0; p < PieceCount; ++p) {
+        index[(unsigned char) PieceChars[p]] = p;
+    }
+    return index;
+}
+
+constexpr std::array<unsigned char, 256> PieceIndex = makePieceIndex();
+
+constexpr int pieceIndex(char piece) {
+    return PieceIndex[(unsigned char) piece];
+}
+
+//True for seven ranks of seven squares of known pieces, then w or b and a turn number
+bool isValidFen(const std::string &fen) {
+    auto split = splitFen(fen);
+    if (split.size() != 9 || (split[7] != "w" && split[7] != "b") || split[8].empty() || split[8].size() > 9 ||
+        split[8].find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    for (int rank = 0; rank < 7; ++rank) {
+        int squares = 0;
+        for (char c: split[rank]) {
+            if (c >= '1' && c <= '7') {
+                squares += c - '0';
+            } else if (pieceIndex(c) < PieceCount) {
+                squares++;
+            } else {
+                return false;
+            }
+        }
+        if (squares != 7) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Pieces by their 4 bit code in packed boards; the monkey and crocodile come last so older files read the same
+const char PackedPieces[] = "_PEZLpezlMCmc";
+
+constexpr std::array<unsigned char, PieceCount + 1> PackedCodes = {1, 2, 3, 4, 9, 10, 5, 6, 7, 8, 11, 12, 0};
+
+//Packs the 49 squares into 25 bytes, two 4 bit piece codes per byte with the even square in the low bits
+void packSquares(const std::array<char, 49> &b, unsigned char *packed) {
+    std::fill(packed, packed + 25, 0);
+    for (int i = 0; i < 49; ++i) {
+        packed[i / 2] |= PackedCodes[pieceIndex(b[i])] << (4 * (i % 2));
+    }
+}
+
+void unpackSquares(const unsigned char *packed, std::array<char, 49> &b) {
+    for (int i = 0; i < 49; ++i) {
+        b[i] = PackedPieces[(packed[i / 2] >> (4 * (i % 2))) & 0xF];
+    }
+}
+
+//A whole position in 28 bytes: the packed squares, the side to move and the turn number
+struct PackedPosition {
+    unsigned char squares[25];
+    unsigned char black;
+    unsigned short turn;
+};
+
+PackedPosition packPosition(const std::array<char, 49> &b, char toPlay, int turn) {
+    PackedPosition packed{};
+    packSquares(b, packed.squares);
+    packed.black = toPlay == 'b';
+    packed.turn = (unsigned short) turn;
+    return packed;
+}
+
 void printMoves(const std::vector<std::string> &moves) {
     std::string sep;
     for (const auto &i: moves) {
@@ -445,4 +1513,224 @@ void printMoves(const std::vector<std::string> &moves) {
 }
 
 
+/*
+ * Optional NNUE style evaluator: 588 piece-square inputs (the 12 pieces of the Piece enum on 49 squares)
+ * feed NNUE_HIDDEN int16 neurons per perspective, black's perspective seeing the board turned around with the
+ * colours swapped. The side to move's and the other side's neurons, clipped to [0, NNUE_QA], meet int8 output
+ * weights; the sum over NNUE_QA * NNUE_QB times NNUE_OUTPUT_SCALE is the score in centipawns.
+ *
+ * Weights file: "CGNN", version and hidden size as uint32, then int16 biases[hidden], int16
+ * weights[588][hidden], int8 output weights[2 * hidden] (side to move first) and an int32 output bias.
+ */
+struct NNUENetwork {
+    alignas(32) int16_t featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(32) int16_t featureBias[NNUE_HIDDEN];
+    alignas(32) int16_t outputWeights[2 * NNUE_HIDDEN];
+    int outputBias;
+};
+
+//First layer sums for white's ([0]) and black's ([1]) perspective
+struct NNUEAccumulator {
+    alignas(32) int16_t values[2][NNUE_HIDDEN];
+};
+
+bool loadNetwork(const std::string &path, NNUENetwork &network) {
+    std::ifstream input(path, std::ios::binary);
+    char magic[4];
+    unsigned int version, hidden;
+    input.read(magic, 4);
+    input.read(reinterpret_cast<char *>(&version), sizeof(version));
+    input.read(reinterpret_cast<char *>(&hidden), sizeof(hidden));
+    if (!input || std::memcmp(magic, NNUE_MAGIC, 4) != 0 || version != NNUE_VERSION || hidden != NNUE_HIDDEN) {
+        return false;
+    }
+    std::array<int8_t, 2 * NNUE_HIDDEN> output{};
+    input.read(reinterpret_cast<char *>(network.featureBias), sizeof(network.featureBias));
+    input.read(reinterpret_cast<char *>(network.featureWeights), sizeof(network.featureWeights));
+    input.read(reinterpret_cast<char *>(output.data()), output.size());
+    input.read(reinterpret_cast<char *>(&network.outputBias), sizeof(network.outputBias));
+    std::copy(output.begin(), output.end(), network.outputWeights);
+    return (bool) input;
+}
+
+int getNNUEFeature(char piece, int square, int perspective) {
+    int p = pieceIndex(piece);
+    if (perspective == 1) {
+        p = p < BlackPawn ? p + BlackPawn : p - BlackPawn;
+        square = 48 - square;
+    }
+    return p * 49 + square;
+}
+
+//Adds (sign 1) or removes (sign -1) a piece in both perspectives
+void updateAccumulator(const NNUENetwork &network, NNUEAccumulator &accumulator, char piece, int square, int sign) {
+    for (int perspective = 0; perspective < 2; ++perspective) {
+        const int16_t *weights = network.featureWeights[getNNUEFeature(piece, square, perspective)];
+        int16_t *values = accumulator.values[perspective];
+#if defined(__AVX2__)
+        for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(values + i));
+            __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+            v = sign > 0 ? _mm256_add_epi16(v, w) : _mm256_sub_epi16(v, w);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(values + i), v);
+        }
+#elif defined(__SSE2__)
+        for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(values + i));
+            __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights + i));
+            v = sign > 0 ? _mm_add_epi16(v, w) : _mm_sub_epi16(v, w);
+            _mm_store_si128(reinterpret_cast<__m128i *>(values + i), v);
+        }
+#else
+        for (int i = 0; i < NNUE_HIDDEN; ++i) {
+            values[i] = (int16_t) (values[i] + sign * weights[i]);
+        }
+#endif
+    }
+}
+
+void refreshAccumulator(const NNUENetwork &network, NNUEAccumulator &accumulator, const std::array<char, 49> &b) {
+    std::copy(network.featureBias, network.featureBias + NNUE_HIDDEN, accumulator.values[0]);
+    std::copy(network.featureBias, network.featureBias + NNUE_HIDDEN, accumulator.values[1]);
+    for (int i = 0; i < 49; ++i) {
+        if (b[i] != '_') {
+            updateAccumulator(network, accumulator, b[i], i, 1);
+        }
+    }
+}
+
+//Clipped neurons dotted with the output weights, side to move first
+int evaluateAccumulator(const NNUENetwork &network, const NNUEAccumulator &accumulator, char toPlay) {
+    const int16_t *sides[2] = {accumulator.values[toPlay == 'w' ? 0 : 1], accumulator.values[toPlay == 'w' ? 1 : 0]};
+    int sum = network.outputBias;
+    for (int side = 0; side < 2; ++side) {
+        const int16_t *weights = network.outputWeights + side * NNUE_HIDDEN;
+#if defined(__AVX2__)
+        __m256i total = _mm256_setzero_si256();
+        for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(sides[side] + i));
+            v = _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), _mm256_set1_epi16(NNUE_QA));
+            __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+            total = _mm256_add_epi32(total, _mm256_madd_epi16(v, w));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+        sum += _mm_cvtsi128_si32(half);
+#elif defined(__SSE2__)
+        __m128i total = _mm_setzero_si128();
+        for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(sides[side] + i));
+            v = _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(NNUE_QA));
+            __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights + i));
+            total = _mm_add_epi32(total, _mm_madd_epi16(v, w));
+        }
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4E));
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xB1));
+        sum += _mm_cvtsi128_si32(total);
+#else
+        for (int i = 0; i < NNUE_HIDDEN; ++i) {
+            sum += std::min(std::max((int) sides[side][i], 0), NNUE_QA) * weights[i];
+        }
+#endif
+    }
+    return (int) ((long long) sum * NNUE_OUTPUT_SCALE / (NNUE_QA * NNUE_QB));
+}
+
+
+/*
+ * Children of a frontier node as a structure of arrays. A move other than a monkey's jump changes at most its
+ * from and to squares and the seven river squares (drowning), so change slot j of child i holds the features
+ * (piece * 49 + square, NoPiece for an empty square) before and after the move at one of those squares.
+ */
+struct FrontierBatch {
+    int count = 0;
+    alignas(32) int16_t before[FRONTIER_CHANGES][FRONTIER_MAX_CHILDREN];
+    alignas(32) int16_t after[FRONTIER_CHANGES][FRONTIER_MAX_CHILDREN];
+    alignas(32) int material[FRONTIER_MAX_CHILDREN];
+    alignas(32) int placement[FRONTIER_MAX_CHILDREN];
+    char state[FRONTIER_MAX_CHILDREN];
+};
+
+//Adds each child's change to the parent's material and placement scores in one pass per change slot
+void evaluateFrontierBatch(FrontierBatch &batch, const int *materialTable, const int *placementTable,
+                           int baseMaterial, int basePlacement) {
+    const int count = batch.count;
+    for (int i = 0; i < count; ++i) {
+        batch.material[i] = baseMaterial;
+        batch.placement[i] = basePlacement;
+    }
+    for (int j = 0; j < FRONTIER_CHANGES; ++j) {
+        const int16_t *before = batch.before[j];
+        const int16_t *after = batch.after[j];
+        for (int i = 0; i < count; ++i) {
+            batch.material[i] += materialTable[after[i]] - materialTable[before[i]];
+            batch.placement[i] += placementTable[after[i]] - placementTable[before[i]];
+        }
+    }
+}
+
+
+enum SearchPhase {
+    PhaseMoveGen, PhaseMakeMove, PhaseEval, PhaseTT, PhaseTimeCheck, PhaseCount
+};
+
+const char *const SearchPhaseNames[PhaseCount] = {"movegen", "makemove", "eval", "tt", "timecheck"};
+const char *const PerfCounterNames[PERF_COUNTERS] = {"cycles", "instructions", "cacheMisses", "branchMisses"};
+
+//Cost of one search phase: entries, nanoseconds, the hardware counters in PerfCounterNames order and allocations
+struct PhaseCounters {
+    unsigned long long calls = 0;
+    unsigned long long nanoseconds = 0;
+    std::array<unsigned long long, PERF_COUNTERS> counters{};
+    unsigned long long allocations = 0;
+    unsigned long long allocatedBytes = 0;
+
+    PhaseCounters &operator+=(const PhaseCounters &p) {
+        calls += p.calls;
+        nanoseconds += p.nanoseconds;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            counters[c] += p.counters[c];
+        }
+        allocations += p.allocations;
+        allocatedBytes += p.allocatedBytes;
+        return *this;
+    }
+
+    PhaseCounters operator-(const PhaseCounters &p) const {
+        PhaseCounters d = *this;
+        d.calls -= p.calls;
+        d.nanoseconds -= p.nanoseconds;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            d.counters[c] -= p.counters[c];
+        }
+        d.allocations -= p.allocations;
+        d.allocatedBytes -= p.allocatedBytes;
+        return d;
+    }
+};
+
+//{"movegen":{"calls":..,"ns":..,"cycles":..},...}, leaving out the counters available is false for and
+//allocations when they are not tracked
+std::string phasesJson(const std::array<PhaseCounters, PhaseCount> &phases,
+                       const std::array<bool, PERF_COUNTERS> &available) {
+    std::ostringstream json;
+    json << "{";
+    for (int p = 0; p < PhaseCount; ++p) {
+        json << (p ? "," : "") << "\"" << SearchPhaseNames[p] << "\":{\"calls\":" << phases[p].calls << ",\"ns\":"
+             << phases[p].nanoseconds;
+        for (int c = 0; c < PERF_COUNTERS; ++c) {
+            if (available[c]) {
+                json << ",\"" << PerfCounterNames[c] << "\":" << phases[p].counters[c];
+            }
+        }
+        if (allocationTracking()) {
+            json << ",\"allocations\":" << phases[p].allocations << ",\"allocatedBytes\":" << phases[p].allocatedBytes;
+        }
+        json << "}";
+    }
+    json << "}";
+    return json.str();
+}
+
 #endif //CONGO_CONGO_H
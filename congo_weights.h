@@ -0,0 +1,66 @@
+//Evaluation weights in centipawns from white's side. ./congo tune rewrites this file with fitted values.
+#ifndef CONGO_WEIGHTS_H
+#define CONGO_WEIGHTS_H
+
+#include <array>
+
+constexpr int PawnValue = 100;
+constexpr int ElephantValue = 200;
+constexpr int ZebraValue = 300;
+constexpr int MonkeyValue = 350;
+constexpr int CrocodileValue = 300;
+constexpr int MobilityWeight = 1;
+constexpr int AttackWeight = 1;
+constexpr int LionAttackWeight = 10;
+
+//Piece-square tables for white pieces, a7 (index 0) to g1 (index 48); black pieces use index 48 - square
+constexpr std::array<int, 49> PawnSquareTable =
+        {0, 0, 0, 0, 0, 0, 0,
+         5, 5, 5, 5, 5, 5, 5,
+         7, 8, 9, 10, 9, 8, 7,
+         -7, -5, -4, -3, -4, -5, -7,
+         -3, 2, 7, 8, 7, 2, -3,
+         3, 3, 9, 9, 9, 3, 3,
+         0, 0, 0, 0, 0, 0, 0};
+constexpr std::array<int, 49> ElephantSquareTable =
+        {-50, -30, -30, -30, -30, -30, -50,
+         -20, 10, 10, 15, 10, 10, -20,
+         -20, 20, 25, 30, 25, 20, -20,
+         -25, -5, -5, -5, -5, -5, -25,
+         -20, 20, 25, 30, 25, 20, -20,
+         -20, 10, 10, 15, 10, 10, -20,
+         -50, -30, -30, -30, -30, -30, -50};
+constexpr std::array<int, 49> ZebraSquareTable =
+        {-50, -40, -30, -30, -30, -40, -50,
+         -40, -20, 0, 0, 0, -20, -40,
+         -30, 0, 10, 15, 10, 0, -30,
+         -30, -5, -15, -20, -15, -5, -30,
+         -30, 0, 10, 15, 10, 0, -30,
+         -40, -20, 0, 0, 0, -2, -40,
+         -50, -40, -30, -30, -30, -40, -50};
+constexpr std::array<int, 49> MonkeySquareTable =
+        {-30, -20, -10, -10, -10, -20, -30,
+         -20, 10, 15, 15, 15, 10, -20,
+         -10, 15, 20, 25, 20, 15, -10,
+         -30, -20, -20, -20, -20, -20, -30,
+         -10, 10, 15, 20, 15, 10, -10,
+         -20, 0, 5, 5, 5, 0, -20,
+         -30, -20, -10, -10, -10, -20, -30};
+constexpr std::array<int, 49> CrocodileSquareTable =
+        {-30, -20, -10, -10, -10, -20, -30,
+         -20, 0, 5, 5, 5, 0, -20,
+         -10, 5, 10, 10, 10, 5, -10,
+         5, 10, 15, 20, 15, 10, 5,
+         -10, 5, 10, 10, 10, 5, -10,
+         -20, 0, 5, 5, 5, 0, -20,
+         -30, -20, -10, -10, -10, -20, -30};
+constexpr std::array<int, 49> LionSquareTable =
+        {0, 0, 0, 0, 0, 0, 0,
+         0, 0, 0, 0, 0, 0, 0,
+         0, 0, 0, 0, 0, 0, 0,
+         0, 0, 0, 0, 0, 0, 0,
+         0, 0, -20, -10, -20, 0, 0,
+         0, 0, -5, 2, -5, 0, 0,
+         0, 0, 10, 0, 10, 0, 0};
+
+#endif //CONGO_WEIGHTS_H